@@ -0,0 +1,309 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Self-contained microbenchmark harness used by the programs in bench/.
+
+#ifndef TB_BENCH_H
+#define TB_BENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+namespace tb::bench {
+
+  // Prevents the compiler from discarding value or assuming it is constant.
+  template<typename T>
+    inline void do_not_optimize(T const& value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+      asm volatile("" : : "r,m"(value) : "memory");
+#else
+      static volatile const void* sink;
+      sink = &value;
+#endif
+    }
+
+  // Forces all pending memory writes to be considered observable.
+  inline void clobber_memory()
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#endif
+  }
+
+  // Hardware counters read around each measured region with perf_event_open.
+  // Events the kernel refuses (no PMU, perf_event_paranoid, virtual machines)
+  // are simply reported as unavailable.
+  class perf_counters {
+  public:
+    enum event { cycles, instructions, l1d_misses, llc_misses, dtlb_misses,
+                 branch_misses, count };
+
+    static constexpr const char* names[count] = {
+      "cyc", "ins", "L1Dm", "LLCm", "dTLBm", "brm"
+    };
+
+    perf_counters()
+    {
+#if defined(__linux__)
+      auto cache = [](std::uint64_t id) {
+        return id | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      };
+      const std::uint32_t types[count] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+      };
+      const std::uint64_t configs[count] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        cache(PERF_COUNT_HW_CACHE_L1D), cache(PERF_COUNT_HW_CACHE_LL),
+        cache(PERF_COUNT_HW_CACHE_DTLB), PERF_COUNT_HW_BRANCH_MISSES
+      };
+      for (int i = 0; i < count; ++i) {
+        perf_event_attr attr{};
+        attr.size = sizeof attr;
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                         | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds_[i] = static_cast<int>(
+          ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      }
+#endif
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    ~perf_counters()
+    {
+#if defined(__linux__)
+      for (int fd : fds_) if (fd >= 0) ::close(fd);
+#endif
+    }
+
+    bool any() const noexcept
+    { return std::any_of(fds_, fds_ + count, [](int fd) { return fd >= 0; }); }
+
+    void start() noexcept
+    {
+#if defined(__linux__)
+      for (int fd : fds_) if (fd >= 0) ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      for (int fd : fds_) if (fd >= 0) ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    // Stops counting and stores the counts, scaled for multiplexing, in out.
+    // Unavailable events are NaN.
+    void stop(double (&out)[count]) noexcept
+    {
+#if defined(__linux__)
+      for (int fd : fds_) if (fd >= 0) ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+      for (int i = 0; i < count; ++i) {
+        out[i] = std::nan("");
+#if defined(__linux__)
+        std::uint64_t v[3];
+        if (fds_[i] >= 0 && ::read(fds_[i], v, sizeof v) == sizeof v && v[2] > 0)
+          out[i] = static_cast<double>(v[0]) * v[1] / v[2];
+#endif
+      }
+    }
+
+  private:
+    int fds_[count] = { -1, -1, -1, -1, -1, -1 };
+  };
+
+  struct options {
+    std::string filter;         // run only benchmarks containing this text
+    bool large = false;         // include ~1 GB arrays
+    int repetitions = 15;
+    int warmup = 2;
+    double min_seconds = 0.01;  // minimum duration of one repetition
+    bool counters = false;      // report hardware counters per element
+  };
+
+  inline options parse_options(int argc, char** argv)
+  {
+    options opt;
+    for (int i = 1; i < argc; ++i) {
+      const char* arg = argv[i];
+      if (std::strcmp(arg, "--large") == 0) opt.large = true;
+      else if (std::strcmp(arg, "--counters") == 0) opt.counters = true;
+      else if (std::strncmp(arg, "--reps=", 7) == 0) opt.repetitions = std::atoi(arg + 7);
+      else if (std::strncmp(arg, "--warmup=", 9) == 0) opt.warmup = std::atoi(arg + 9);
+      else if (std::strncmp(arg, "--min-time=", 11) == 0) opt.min_seconds = std::atof(arg + 11);
+      else opt.filter = arg;
+    }
+    opt.repetitions = std::max(opt.repetitions, 1);
+    return opt;
+  }
+
+  struct result {
+    std::string name;
+    double median_ns = 0;  // per iteration
+    double p10_ns = 0;
+    double p90_ns = 0;
+    double elements = 0;   // per iteration
+    double bytes = 0;      // per iteration
+    bool has_counters = false;
+    double counters[perf_counters::count] = {};  // per element
+  };
+
+  // Counters shared by all benchmarks of the process.
+  inline perf_counters& counters()
+  {
+    static perf_counters instance;
+    return instance;
+  }
+
+  inline void print_header(const options& opt = {})
+  {
+    std::printf("%-56s %12s %12s %12s %10s %10s", "benchmark", "median ns",
+                "p10 ns", "p90 ns", "ns/elem", "GB/s");
+    if (opt.counters && !counters().any())
+      std::fprintf(stderr, "note: hardware counters are unavailable\n");
+    if (opt.counters) {
+      for (const char* name : perf_counters::names)
+        std::printf(" %8s/el", name);
+      std::printf(" %8s", "IPC");
+    }
+    std::printf("\n");
+  }
+
+  inline void print(const result& r)
+  {
+    std::printf("%-56s %12.1f %12.1f %12.1f %10.3f %10.2f", r.name.c_str(),
+                r.median_ns, r.p10_ns, r.p90_ns,
+                r.elements > 0 ? r.median_ns / r.elements : 0.0,
+                r.median_ns > 0 ? r.bytes / r.median_ns : 0.0);
+    if (r.has_counters) {
+      for (double c : r.counters) {
+        if (std::isnan(c)) std::printf(" %11s", "-");
+        else std::printf(" %11.4f", c);
+      }
+      const double ipc = r.counters[perf_counters::instructions]
+                         / r.counters[perf_counters::cycles];
+      if (std::isnan(ipc) || std::isinf(ipc)) std::printf(" %8s", "-");
+      else std::printf(" %8.2f", ipc);
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+  }
+
+  // Times f(), which performs one iteration touching the given number of
+  // elements and bytes. Each repetition runs enough iterations to last at
+  // least opt.min_seconds; the per-iteration times of all repetitions are
+  // summarized by their median and 10th/90th percentiles. With
+  // opt.counters, hardware counters are totalled over all repetitions and
+  // reported per element.
+  template<typename F>
+    result measure(const options& opt, const std::string& name,
+                   double elements, double bytes, F&& f)
+    {
+      using clock = std::chrono::steady_clock;
+
+      for (int i = 0; i < opt.warmup; ++i) f();
+
+      // Calibrate the number of iterations per repetition.
+      std::size_t iterations = 1;
+      for (;;) {
+        auto start = clock::now();
+        for (std::size_t i = 0; i < iterations; ++i) f();
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        if (elapsed.count() >= opt.min_seconds || iterations >= (1u << 30))
+          break;
+        iterations *= elapsed.count() > 0
+          ? std::clamp<std::size_t>(
+              static_cast<std::size_t>(opt.min_seconds / elapsed.count()) + 1, 2, 10)
+          : 10;
+      }
+
+      std::vector<double> samples;
+      samples.reserve(opt.repetitions);
+      double totals[perf_counters::count] = {};
+      for (int r = 0; r < opt.repetitions; ++r) {
+        double counts[perf_counters::count];
+        if (opt.counters) counters().start();
+        auto start = clock::now();
+        for (std::size_t i = 0; i < iterations; ++i) f();
+        auto stop = clock::now();
+        if (opt.counters) {
+          counters().stop(counts);
+          for (int c = 0; c < perf_counters::count; ++c) totals[c] += counts[c];
+        }
+        std::chrono::duration<double, std::nano> elapsed = stop - start;
+        samples.push_back(elapsed.count() / iterations);
+      }
+      std::sort(samples.begin(), samples.end());
+      auto percentile = [&](double p) {
+        return samples[static_cast<std::size_t>(p * (samples.size() - 1) + 0.5)];
+      };
+
+      result res;
+      res.name = name;
+      res.median_ns = percentile(0.5);
+      res.p10_ns = percentile(0.1);
+      res.p90_ns = percentile(0.9);
+      res.elements = elements;
+      res.bytes = bytes;
+      if (opt.counters) {
+        res.has_counters = true;
+        const double n = static_cast<double>(iterations) * opt.repetitions
+                         * std::max(elements, 1.0);
+        for (int c = 0; c < perf_counters::count; ++c)
+          res.counters[c] = totals[c] / n;
+      }
+      return res;
+    }
+
+  // Measures and prints f() unless its name is excluded by opt.filter.
+  template<typename F>
+    bool run(const options& opt, const std::string& name, double elements,
+             double bytes, F&& f)
+    {
+      if (!opt.filter.empty() && name.find(opt.filter) == std::string::npos)
+        return false;
+      print(measure(opt, name, elements, bytes, std::forward<F>(f)));
+      return true;
+    }
+
+} // namespace tb::bench
+#endif//TB_BENCH_H
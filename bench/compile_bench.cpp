@@ -0,0 +1,258 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Compile-time cost of multi_array template instantiation (POSIX only).
+//
+//   g++ -std=c++20 -O2 bench/compile_bench.cpp -o compile_bench
+//   ./compile_bench [--cxx=COMPILER] [--flags="-O2"] [--include=src]
+//                   [--max-rank=N] [--count=N] [--keep]
+//
+// Generates translation units that instantiate multi_array for ranks 1 to
+// max-rank, exercising element access and whole-array operations,
+// Nested_initializer construction, get<I, J...> and multi_array_for /
+// to_multi_array. Each unit is compiled separately and its wall time, the
+// compiler's peak resident memory and the object size are reported, next
+// to a baseline unit that only includes the header.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+  struct config {
+    std::string cxx = std::getenv("CXX") ? std::getenv("CXX") : "c++";
+    std::string flags = "-O2";
+    std::string include = "src";
+    int max_rank = 8;
+    int count = 16;     // instantiations per translation unit
+    bool keep = false;  // keep the generated sources in the work directory
+  };
+
+  config parse(int argc, char** argv)
+  {
+    config cfg;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      auto value = [&](const char* key) {
+        return arg.rfind(key, 0) == 0 ? arg.substr(std::strlen(key)) : std::string();
+      };
+      if (arg.rfind("--cxx=", 0) == 0) cfg.cxx = value("--cxx=");
+      else if (arg.rfind("--flags=", 0) == 0) cfg.flags = value("--flags=");
+      else if (arg.rfind("--include=", 0) == 0) cfg.include = value("--include=");
+      else if (arg.rfind("--max-rank=", 0) == 0) cfg.max_rank = std::atoi(value("--max-rank=").c_str());
+      else if (arg.rfind("--count=", 0) == 0) cfg.count = std::atoi(value("--count=").c_str());
+      else if (arg == "--keep") cfg.keep = true;
+    }
+    return cfg;
+  }
+
+  // Extents "2, 2, ..., last" of the given rank.
+  std::string extents(int rank, int last, const char* sep = ", ")
+  {
+    std::string s;
+    for (int i = 1; i < rank; ++i) s += "2" + std::string(sep);
+    return s + std::to_string(last);
+  }
+
+  std::string c_extents(int rank, int last)
+  {
+    std::string s;
+    for (int i = 1; i < rank; ++i) s += "[2]";
+    return s + "[" + std::to_string(last) + "]";
+  }
+
+  // Nested braces initializing every element of a 2 x ... x 2 x last array.
+  std::string nested_init(int rank, int last)
+  {
+    if (rank == 1) {
+      std::string s = "{";
+      for (int i = 0; i < last; ++i) s += (i ? ", " : "") + std::to_string(i);
+      return s + "}";
+    }
+    const std::string sub = nested_init(rank - 1, last);
+    return "{" + sub + ", " + sub + "}";
+  }
+
+  const char* prologue =
+    "#include \"multi_array.h\"\n"
+    "#include <type_traits>\n"
+    "using namespace tb;\n";
+
+  std::string unit_baseline(int, int)
+  { return prologue; }
+
+  std::string unit_operations(int rank, int count)
+  {
+    std::ostringstream s;
+    s << prologue
+      << "template<typename A> bool use(A& a, A& b) {\n"
+      << "  a.fill(1); A c(a); b.swap(c); return a == b;\n"
+      << "}\n";
+    std::string zeros = "0";
+    for (int i = 1; i < rank; ++i) zeros += ", 0";
+    for (int k = 1; k <= count; ++k)
+      s << "bool f" << k << "(multi_array<int, " << extents(rank, k) << ">& a, "
+        << "multi_array<int, " << extents(rank, k) << ">& b) {\n"
+        << "  a(" << zeros << ") = a.at(" << zeros << ") + 1;\n"
+        << "  return use(a, b);\n}\n";
+    return s.str();
+  }
+
+  std::string unit_nested_initializer(int rank, int count)
+  {
+    std::ostringstream s;
+    s << prologue;
+    for (int k = 1; k <= count; ++k)
+      s << "multi_array<int, " << extents(rank, k) << "> g" << k << "() {\n"
+        << "  return " << nested_init(rank, k) << ";\n}\n";
+    return s.str();
+  }
+
+  std::string unit_get(int rank, int count)
+  {
+    std::ostringstream s;
+    s << prologue
+      << "int g(const multi_array<int, " << extents(rank, 2) << ">& a) {\n"
+      << "  int sum = 0;\n";
+    // Every full index tuple of the 2 x ... x 2 array, up to count * 8.
+    const int tuples = std::min(1 << rank, count * 8);
+    for (int t = 0; t < tuples; ++t) {
+      s << "  sum += get<";
+      for (int d = 0; d < rank; ++d) s << (d ? ", " : "") << ((t >> d) & 1);
+      s << ">(a);\n";
+    }
+    s << "  return sum;\n}\n";
+    return s.str();
+  }
+
+  std::string unit_multi_array_for(int rank, int count)
+  {
+    std::ostringstream s;
+    s << prologue;
+    for (int k = 1; k <= count; ++k)
+      s << "static_assert(std::is_same_v<multi_array_for<int" << c_extents(rank, k)
+        << ">, multi_array<int, " << extents(rank, k) << ">>);\n"
+        << "auto h" << k << "(const int (&c)" << c_extents(rank, k) << ") {\n"
+        << "  return to_multi_array(c);\n}\n";
+    return s.str();
+  }
+
+  struct measurement {
+    bool ok = false;
+    double seconds = 0;
+    double peak_mb = 0;
+    double object_kb = 0;
+  };
+
+  // Runs the compiler on source and measures it with wait4().
+  measurement compile(const config& cfg, const std::filesystem::path& source)
+  {
+    const auto object = std::filesystem::path(source).replace_extension(".o");
+    std::vector<std::string> args = { cfg.cxx, "-std=c++20" };
+    std::istringstream flags(cfg.flags);
+    for (std::string f; flags >> f; ) args.push_back(f);
+    args.insert(args.end(), { "-I", cfg.include, "-c", source.string(),
+                              "-o", object.string() });
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back(a.data());
+    argv.push_back(nullptr);
+
+    measurement m;
+    auto start = std::chrono::steady_clock::now();
+    const pid_t pid = ::fork();
+    if (pid == 0) {
+      ::execvp(argv[0], argv.data());
+      std::_Exit(127);
+    }
+    int status = 0;
+    rusage usage{};
+    if (pid < 0 || ::wait4(pid, &status, 0, &usage) < 0) return m;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    m.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    m.seconds = elapsed.count();
+    m.peak_mb = usage.ru_maxrss / 1024.0;  // kilobytes on Linux
+    std::error_code ec;
+    m.object_kb = std::filesystem::file_size(object, ec) / 1024.0;
+    if (!cfg.keep) std::filesystem::remove(object, ec);
+    return m;
+  }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  config cfg = parse(argc, argv);
+  cfg.include = std::filesystem::absolute(cfg.include).string();
+  const auto dir = std::filesystem::temp_directory_path()
+                   / ("multi_array_compile_bench_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+
+  struct generator {
+    const char* name;
+    std::string (*make)(int, int);
+  };
+  const generator generators[] = {
+    { "baseline", unit_baseline },
+    { "operations", unit_operations },
+    { "nested_initializer", unit_nested_initializer },
+    { "get<I,J...>", unit_get },
+    { "multi_array_for", unit_multi_array_for },
+  };
+
+  std::printf("compiler: %s %s\n", cfg.cxx.c_str(), cfg.flags.c_str());
+  std::printf("%-20s %5s %6s %10s %10s %10s\n", "case", "rank", "count",
+              "seconds", "peak MB", "object KB");
+  int failures = 0;
+  for (const auto& g : generators) {
+    const int ranks = std::string(g.name) == "baseline" ? 1 : cfg.max_rank;
+    for (int rank = 1; rank <= ranks; ++rank) {
+      const auto source = dir / (std::string("tu_") + std::to_string(&g - generators)
+                                 + "_" + std::to_string(rank) + ".cpp");
+      std::ofstream(source) << g.make(rank, cfg.count);
+      const measurement m = compile(cfg, source);
+      if (!m.ok) {
+        ++failures;
+        std::printf("%-20s %5d %6d %10s\n", g.name, rank, cfg.count, "FAILED");
+        continue;
+      }
+      std::printf("%-20s %5d %6d %10.3f %10.1f %10.1f\n", g.name, rank,
+                  cfg.count, m.seconds, m.peak_mb, m.object_kb);
+      std::fflush(stdout);
+    }
+  }
+
+  if (cfg.keep) std::printf("sources kept in %s\n", dir.c_str());
+  else std::filesystem::remove_all(dir);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,248 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Microbenchmarks for multi_array against built-in arrays and std::vector.
+//
+//   g++ -std=c++20 -O2 -march=native -DNDEBUG -I src bench/multi_array_bench.cpp
+//   ./a.out [filter] [--large] [--counters] [--reps=N] [--min-time=S]
+//
+// Shapes range from a few elements to ~1 GB (the latter only with --large).
+
+#include "multi_array.h"
+#include "bench.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace tb;
+using namespace tb::bench;
+
+namespace {
+
+  // operator== and to_multi_array() take or return arrays by value, so they
+  // are only measured for arrays that fit comfortably on the stack.
+  constexpr std::size_t by_value_limit = std::size_t{1} << 20;
+
+  template<typename T> const char* type_name();
+  template<> const char* type_name<float>() { return "float"; }
+  template<> const char* type_name<double>() { return "double"; }
+  template<> const char* type_name<std::int8_t>() { return "int8"; }
+
+  template<typename T, std::size_t... E>
+    std::string shape_name()
+    {
+      std::string s = type_name<T>();
+      s += '<';
+      ((s += std::to_string(E) + ','), ...);
+      s.back() = '>';
+      return s;
+    }
+
+  // Calls f(i, j, ...) for every index of the extents E... in row-major order.
+  template<std::size_t... E, typename F, typename... I>
+    inline void for_each_index(F& f, I... i)
+    {
+      constexpr std::size_t extents[] = { E... };
+      if constexpr (sizeof...(I) == sizeof...(E)) {
+        f(i...);
+      } else {
+        for (std::size_t k = 0; k < extents[sizeof...(I)]; ++k)
+          for_each_index<E...>(f, i..., k);
+      }
+    }
+
+  // Chained operator[] for built-in arrays and multi_arrays alike.
+  template<typename X>
+    inline auto& subscript(X& x) { return x; }
+
+  template<typename X, typename I, typename... R>
+    inline auto& subscript(X& x, I i, R... r) { return subscript(x[i], r...); }
+
+  // Nested range-based iteration down to the elements.
+  template<typename X, typename T>
+    inline void iterate(const X& x, T& sum)
+    {
+      if constexpr (Multi_array<X>) {
+        for (const auto& sub : x) iterate(sub, sum);
+      } else {
+        sum += x;
+      }
+    }
+
+  template<typename T, std::size_t... E>
+    void bench_shape(const options& opt)
+    {
+      using A = multi_array<T, E...>;
+      using C = typename C_array_impl<T, static_cast<int>(E)...>::type;
+      constexpr std::size_t n = A::total_size();
+      constexpr double bytes = static_cast<double>(n * sizeof(T));
+      const std::string shape = shape_name<T, E...>() + '/';
+
+      std::unique_ptr<A> a(new A), b(new A);
+      struct c_holder { C array; };
+      std::unique_ptr<c_holder> c_storage(new c_holder);
+      C* c = &c_storage->array;
+      T* flat_c = reinterpret_cast<T*>(c);
+      std::vector<T> v(n), w(n);
+      for (std::size_t i = 0; i < n; ++i)
+        a->data()[i] = b->data()[i] = flat_c[i] = v[i] = w[i] = T(i % 7);
+
+      // Element access over the whole array.
+      run(opt, shape + "operator()", n, bytes, [&] {
+        T sum = 0;
+        auto f = [&](auto... i) { sum += (*a)(i...); };
+        for_each_index<E...>(f);
+        do_not_optimize(sum);
+      });
+      run(opt, shape + "operator[]", n, bytes, [&] {
+        T sum = 0;
+        auto f = [&](auto... i) { sum += subscript(*a, i...); };
+        for_each_index<E...>(f);
+        do_not_optimize(sum);
+      });
+      run(opt, shape + "at", n, bytes, [&] {
+        T sum = 0;
+        auto f = [&](auto... i) { sum += a->at(i...); };
+        for_each_index<E...>(f);
+        do_not_optimize(sum);
+      });
+      run(opt, shape + "c_array[]", n, bytes, [&] {
+        T sum = 0;
+        auto f = [&](auto... i) { sum += subscript(*c, i...); };
+        for_each_index<E...>(f);
+        do_not_optimize(sum);
+      });
+      run(opt, shape + "iteration", n, bytes, [&] {
+        T sum = 0;
+        iterate(*a, sum);
+        do_not_optimize(sum);
+      });
+      run(opt, shape + "vector_iteration", n, bytes, [&] {
+        T sum = 0;
+        for (const T& x : v) sum += x;
+        do_not_optimize(sum);
+      });
+      run(opt, shape + "get<>", 1, sizeof(T), [&] {
+        do_not_optimize(get<(E - 1)...>(*a));
+        clobber_memory();
+      });
+
+      // Whole-array operations.
+      T value = 1;
+      run(opt, shape + "fill", n, bytes, [&] {
+        a->fill(value);
+        do_not_optimize(*a);
+      });
+      run(opt, shape + "c_array_fill", n, bytes, [&] {
+        std::fill_n(flat_c, n, value);
+        do_not_optimize(*c);
+      });
+      run(opt, shape + "vector_fill", n, bytes, [&] {
+        std::fill(v.begin(), v.end(), value);
+        do_not_optimize(v.data());
+        clobber_memory();
+      });
+      run(opt, shape + "swap", n, 4 * bytes, [&] {
+        a->swap(*b);
+        clobber_memory();
+      });
+      run(opt, shape + "vector_swap_ranges", n, 4 * bytes, [&] {
+        std::swap_ranges(v.begin(), v.end(), w.begin());
+        clobber_memory();
+      });
+      run(opt, shape + "copy_construct", n, 2 * bytes, [&] {
+        std::construct_at(b.get(), *a);
+        clobber_memory();
+      });
+      run(opt, shape + "c_array_copy", n, 2 * bytes, [&] {
+        std::copy_n(a->data(), n, flat_c);
+        clobber_memory();
+      });
+      run(opt, shape + "vector_copy_assign", n, 2 * bytes, [&] {
+        w = v;
+        clobber_memory();
+      });
+      if constexpr (sizeof(A) <= by_value_limit) {
+        run(opt, shape + "operator==", n, 2 * bytes, [&] {
+          do_not_optimize(*a == *b);
+        });
+        run(opt, shape + "transform", n, 3 * bytes, [&] {
+          auto r = transform(*a, *b, [](T x, T y) { return T(x + y); });
+          do_not_optimize(r);
+        });
+        run(opt, shape + "to_multi_array", n, 2 * bytes, [&] {
+          auto r = to_multi_array(*c);
+          do_not_optimize(r);
+        });
+      }
+      run(opt, shape + "vector_equal", n, 2 * bytes, [&] {
+        do_not_optimize(v == w);
+      });
+    }
+
+  // Vector and matrix sized (where fill, swap, operator== and transform are
+  // unrolled), tiny, cache-sized and (optionally) ~1 GB shapes for ranks 1
+  // to 6.
+  template<typename T>
+    void bench_type(const options& opt, bool large)
+    {
+      bench_shape<T, 3>(opt);
+      bench_shape<T, 4>(opt);
+      bench_shape<T, 16>(opt);
+      bench_shape<T, 4, 4>(opt);
+
+      bench_shape<T, 64>(opt);
+      bench_shape<T, 8, 8>(opt);
+      bench_shape<T, 4, 4, 4>(opt);
+      bench_shape<T, 2, 4, 2, 4>(opt);
+      bench_shape<T, 2, 2, 2, 2, 4>(opt);
+      bench_shape<T, 2, 2, 2, 2, 2, 2>(opt);
+
+      bench_shape<T, 262144>(opt);
+      bench_shape<T, 512, 512>(opt);
+      bench_shape<T, 64, 64, 64>(opt);
+      bench_shape<T, 16, 16, 32, 32>(opt);
+      bench_shape<T, 8, 8, 8, 8, 64>(opt);
+      bench_shape<T, 8, 8, 8, 8, 8, 8>(opt);
+
+      if (large) {
+        bench_shape<T, 268435456>(opt);
+        bench_shape<T, 16384, 16384>(opt);
+        bench_shape<T, 512, 512, 1024>(opt);
+        bench_shape<T, 128, 128, 128, 128>(opt);
+        bench_shape<T, 64, 64, 64, 32, 32>(opt);
+        bench_shape<T, 32, 32, 16, 16, 16, 16>(opt);
+      }
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  const options opt = parse_options(argc, argv);
+  print_header(opt);
+  bench_type<float>(opt, opt.large);
+  bench_type<double>(opt, false);
+  bench_type<std::int8_t>(opt, false);
+}
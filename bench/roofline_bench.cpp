@@ -0,0 +1,278 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Roofline calibration for multi_array kernels.
+//
+//   g++ -std=c++20 -O3 -march=native -DNDEBUG -pthread -I src bench/roofline_bench.cpp
+//   ./a.out [--reps=N] [--min-time=S]
+//
+// First measures STREAM copy/scale/add/triad over multi_array storage for
+// working sets from L1 to DRAM and for 1 to hardware_concurrency threads,
+// plus the peak double-precision FMA rate. Then measures the library's
+// kernels and reports each as a fraction of the roofline bound
+// min(peak FLOP/s, arithmetic intensity * peak bandwidth) for its size.
+// As in STREAM, byte counts exclude write-allocate traffic, so kernels that
+// write only lines they have just read (swap) can exceed 100%.
+
+#include "multi_array.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace tb;
+using namespace tb::bench;
+
+namespace {
+
+  // Persistent worker threads; run(f) calls f(thread_index, thread_count) on
+  // every thread, including the caller, and waits for all of them.
+  class thread_team {
+  public:
+    explicit thread_team(unsigned n)
+      : size_(n), start_(n), finish_(n)
+    {
+      for (unsigned t = 1; t < n; ++t)
+        workers_.emplace_back([this, t] {
+          for (;;) {
+            start_.arrive_and_wait();
+            if (stop_) return;
+            task_(t, size_);
+            finish_.arrive_and_wait();
+          }
+        });
+    }
+
+    ~thread_team()
+    {
+      stop_ = true;
+      start_.arrive_and_wait();
+      for (auto& w : workers_) w.join();
+    }
+
+    unsigned size() const noexcept { return size_; }
+
+    void run(const std::function<void(unsigned, unsigned)>& f)
+    {
+      task_ = f;
+      start_.arrive_and_wait();
+      task_(0, size_);
+      finish_.arrive_and_wait();
+    }
+
+  private:
+    unsigned size_;
+    std::barrier<> start_, finish_;
+    std::function<void(unsigned, unsigned)> task_;
+    std::atomic<bool> stop_{false};
+    std::vector<std::thread> workers_;
+  };
+
+  // Working-set sizes, in doubles per array, for the STREAM kernels.
+  struct level { const char* name; std::size_t elements; };
+  constexpr level levels[] = {
+    { "L1", 1024 }, { "L2", 16384 }, { "LLC", 262144 }, { "DRAM", 8388608 }
+  };
+  constexpr std::size_t max_elements = 8388608;
+  using stream_array = multi_array<double, max_elements>;
+
+  struct roof { double bandwidth = 0; double flops = 0; };  // bytes/ns, flop/ns
+
+  template<typename F>
+    double time_ns(const options& opt, F&& f)
+    { return measure(opt, "", 0, 0, std::forward<F>(f)).median_ns; }
+
+  // Peak FLOP rate with independent fused multiply-add chains in registers.
+  double peak_flops(const options& opt, thread_team& team)
+  {
+    constexpr int chains = 32;
+    constexpr int steps = 4096;
+    const double ns = time_ns(opt, [&] {
+      team.run([&](unsigned, unsigned) {
+        double acc[chains];
+        for (int j = 0; j < chains; ++j) acc[j] = j;
+        for (int i = 0; i < steps; ++i)
+          for (int j = 0; j < chains; ++j) acc[j] = acc[j] * 0.999 + 0.001;
+        do_not_optimize(acc);
+      });
+    });
+    return 2.0 * chains * steps * team.size() / ns;
+  }
+
+  struct stream_kernel {
+    const char* name;
+    double bytes;  // per element
+    double flops;  // per element
+    void (*body)(double*, double*, double*, std::size_t, std::size_t);
+  };
+
+  constexpr double scalar = 3.0;
+  constexpr stream_kernel stream_kernels[] = {
+    { "copy", 16, 0, [](double* a, double*, double* c, std::size_t i, std::size_t e) {
+        for (; i < e; ++i) c[i] = a[i]; } },
+    { "scale", 16, 1, [](double*, double* b, double* c, std::size_t i, std::size_t e) {
+        for (; i < e; ++i) b[i] = scalar * c[i]; } },
+    { "add", 24, 1, [](double* a, double* b, double* c, std::size_t i, std::size_t e) {
+        for (; i < e; ++i) c[i] = a[i] + b[i]; } },
+    { "triad", 24, 2, [](double* a, double* b, double* c, std::size_t i, std::size_t e) {
+        for (; i < e; ++i) a[i] = b[i] + scalar * c[i]; } },
+  };
+
+  // Runs the STREAM kernels at every level and records the best bandwidth
+  // seen per level in roofs.
+  void calibrate(const options& opt, thread_team& team, stream_array& a,
+                 stream_array& b, stream_array& c, roof (&roofs)[4])
+  {
+    for (std::size_t l = 0; l < std::size(levels); ++l) {
+      const std::size_t n = levels[l].elements;
+      // Small working sets repeat the kernel inside one dispatch so that
+      // thread synchronization does not dominate.
+      const std::size_t repeat = std::max<std::size_t>(1, 262144 / n);
+      for (const auto& k : stream_kernels) {
+        const double ns = time_ns(opt, [&] {
+          team.run([&](unsigned t, unsigned threads) {
+            for (std::size_t r = 0; r < repeat; ++r) {
+              k.body(a.data(), b.data(), c.data(), n * t / threads,
+                     n * (t + 1) / threads);
+              clobber_memory();
+            }
+          });
+        }) / repeat;
+        const double bw = k.bytes * n / ns;
+        roofs[l].bandwidth = std::max(roofs[l].bandwidth, bw);
+        std::printf("%-6s %8zu %8u %-8s %12.2f %12.2f\n", levels[l].name,
+                    n * sizeof(double), team.size(), k.name, bw,
+                    k.flops * n / ns);
+      }
+    }
+  }
+
+  struct kernel_result {
+    const char* name;
+    std::size_t level;
+    double bytes;
+    double flops;
+    double ns;
+  };
+
+  // Single-threaded library kernels on arrays of the level's size.
+  template<std::size_t N>
+    void library_kernels(const options& opt, std::size_t level,
+                         std::vector<kernel_result>& out)
+    {
+      using A = multi_array<double, N / 64, 64>;
+      std::unique_ptr<A> a(new A), b(new A);
+      a->fill(1.0);
+      b->fill(1.0);
+      constexpr double n = N;
+      constexpr double s = sizeof(double);
+
+      out.push_back({ "fill", level, s * n, 0, time_ns(opt, [&] {
+        a->fill(2.0);
+        clobber_memory();
+      }) });
+      out.push_back({ "copy_construct", level, 2 * s * n, 0, time_ns(opt, [&] {
+        std::construct_at(b.get(), *a);
+        clobber_memory();
+      }) });
+      out.push_back({ "swap", level, 4 * s * n, 0, time_ns(opt, [&] {
+        a->swap(*b);
+        clobber_memory();
+      }) });
+      out.push_back({ "iteration_sum", level, s * n, n, time_ns(opt, [&] {
+        double sum = 0;
+        for (const auto& row : *a)
+          for (double x : row) sum += x;
+        do_not_optimize(sum);
+      }) });
+      if constexpr (sizeof(A) <= (std::size_t{1} << 20)) {
+        out.push_back({ "operator==", level, 2 * s * n, 0, time_ns(opt, [&] {
+          do_not_optimize(*a == *b);
+        }) });
+      }
+    }
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  options opt = parse_options(argc, argv);
+  opt.repetitions = std::min(opt.repetitions, 7);
+
+  std::unique_ptr<stream_array> a(new stream_array), b(new stream_array),
+                                c(new stream_array);
+  a->fill(1.0);
+  b->fill(2.0);
+  c->fill(0.0);
+
+  std::vector<unsigned> thread_counts;
+  const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned t = 1; t < hw; t *= 2) thread_counts.push_back(t);
+  thread_counts.push_back(hw);
+
+  // Roofs for one thread (the library kernels are single-threaded) and for
+  // the whole machine.
+  roof single[4], machine[4];
+
+  std::printf("%-6s %8s %8s %-8s %12s %12s\n", "level", "bytes", "threads",
+              "kernel", "GB/s", "GFLOP/s");
+  for (unsigned t : thread_counts) {
+    thread_team team(t);
+    roof roofs[4];
+    calibrate(opt, team, *a, *b, *c, roofs);
+    const double flops = peak_flops(opt, team);
+    std::printf("%-6s %8s %8u %-8s %12s %12.2f\n", "core", "-", t, "fma", "-",
+                flops);
+    for (int l = 0; l < 4; ++l) {
+      roofs[l].flops = flops;
+      if (t == 1) single[l] = roofs[l];
+      machine[l].bandwidth = std::max(machine[l].bandwidth, roofs[l].bandwidth);
+      machine[l].flops = std::max(machine[l].flops, flops);
+    }
+  }
+
+  std::vector<kernel_result> kernels;
+  library_kernels<levels[0].elements>(opt, 0, kernels);
+  library_kernels<levels[1].elements>(opt, 1, kernels);
+  library_kernels<levels[2].elements>(opt, 2, kernels);
+  library_kernels<levels[3].elements>(opt, 3, kernels);
+
+  std::printf("\n%-16s %-6s %10s %10s %8s %12s %12s\n", "kernel", "level",
+              "GB/s", "GFLOP/s", "AI", "% 1-thread", "% machine");
+  for (const auto& k : kernels) {
+    const double bw = k.bytes / k.ns;
+    const double fl = k.flops / k.ns;
+    const double ai = k.flops / k.bytes;
+    auto fraction = [&](const roof& r) {
+      return ai > 0 ? fl / std::min(r.flops, ai * r.bandwidth)
+                    : bw / r.bandwidth;
+    };
+    std::printf("%-16s %-6s %10.2f %10.2f %8.3f %11.1f%% %11.1f%%\n", k.name,
+                levels[k.level].name, bw, fl, ai, 100 * fraction(single[k.level]),
+                100 * fraction(machine[k.level]));
+  }
+}
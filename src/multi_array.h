@@ -27,12 +27,123 @@ SOFTWARE.
 #include <algorithm>
 #include <initializer_list>
 #include <cassert>
+#include <array>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "multi_array_nontemporal.h"
+
+#ifdef TB_MULTI_ARRAY_TRACE
+#  include "multi_array_trace.h"
+#  define TB_MULTI_ARRAY_TRACED(kind, expr) \
+     ::tb::trace_access(::tb::trace_kind::kind, this, \
+                        [&]() noexcept -> auto& { return expr; })
+#  define TB_MULTI_ARRAY_ITERATOR(type, ptr) type(ptr, this)
+#else
+#  define TB_MULTI_ARRAY_TRACED(kind, expr) expr
+#  define TB_MULTI_ARRAY_ITERATOR(type, ptr) type(ptr)
+#endif
+
+#ifdef TB_MULTI_ARRAY_COPY_ACCOUNTING
+#  include "multi_array_copy.h"
+#  define TB_MULTI_ARRAY_COPIED_AS(type, kind) \
+     const ::tb::copy_scope<type> copy_scope_(::tb::copy_kind::kind)
+#  define TB_MULTI_ARRAY_COPIED(kind) TB_MULTI_ARRAY_COPIED_AS(multi_array, kind)
+#  define TB_MULTI_ARRAY_UNCOUNTED \
+     const ::tb::copy_scope<multi_array> copy_scope_
+#else
+#  define TB_MULTI_ARRAY_COPIED_AS(type, kind)
+#  define TB_MULTI_ARRAY_COPIED(kind)
+#  define TB_MULTI_ARRAY_UNCOUNTED
+#endif
+
+#ifdef TB_MULTI_ARRAY_TELEMETRY
+#  include "multi_array_telemetry.h"
+#  define TB_MULTI_ARRAY_TIMED(op) \
+     const ::tb::telemetry_scope telemetry_scope_(::tb::telemetry_op::op)
+#  define TB_MULTI_ARRAY_UNTIMED const ::tb::telemetry_scope telemetry_scope_
+#else
+#  define TB_MULTI_ARRAY_TIMED(op)
+#  define TB_MULTI_ARRAY_UNTIMED
+#endif
+
+#ifdef TB_MULTI_ARRAY_TIMELINE
+#  include "multi_array_timeline.h"
+#  define TB_MULTI_ARRAY_SPAN(category, name, arg) \
+     const ::tb::timeline_span timeline_span_(category, name, arg)
+#else
+#  define TB_MULTI_ARRAY_SPAN(category, name, arg)
+#endif
+
+#ifdef TB_MULTI_ARRAY_MEMORY_REGISTRY
+#  include "multi_array_memory.h"
+#  define TB_MULTI_ARRAY_REGISTERED(...) \
+     : private ::tb::memory_registration<__VA_ARGS__>
+// Mem-initializer of that base in user-provided copy constructors; a copy
+// is a new instance and registers its own address.
+#  define TB_MULTI_ARRAY_REGISTER(...) \
+     : ::tb::memory_registration<__VA_ARGS__>()
+#else
+#  define TB_MULTI_ARRAY_REGISTERED(...)
+#  define TB_MULTI_ARRAY_REGISTER(...)
+#endif
+
+// Copies are user-provided only when they have to be observed.
+#if defined(TB_MULTI_ARRAY_COPY_ACCOUNTING) || defined(TB_MULTI_ARRAY_TELEMETRY)
+#  define TB_MULTI_ARRAY_OBSERVED_COPIES
+#endif
+
+// Otherwise, and unless instances are registered or traced by address, a
+// multi_array is trivially copyable and trivially relocatable whenever T is.
+#if !defined(TB_MULTI_ARRAY_OBSERVED_COPIES) && !defined(TB_MULTI_ARRAY_MEMORY_REGISTRY) \
+    && !defined(TB_MULTI_ARRAY_TRACE)
+#  define TB_MULTI_ARRAY_TRIVIAL_COPIES
+#endif
 
 namespace tb {
 
   template<typename T>
     concept Index_type = std::convertible_to<std::size_t, T>;
 
+  // Arrays of at most this many elements have their element-wise kernels
+  // unrolled into straight-line code.
+  inline constexpr std::size_t unroll_limit = 16;
+
+  // Type predicate for types whose objects can be moved to a new address
+  // with memcpy, the source then being treated as destroyed. Specialize it
+  // for relocatable types that are not trivially copyable.
+  template<typename T>
+    struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+  template<typename T>
+    inline constexpr bool is_trivially_relocatable_v
+      = is_trivially_relocatable<T>::value;
+
+  // Exchanges n bytes between two distinct objects of a trivially
+  // relocatable type, a block at a time.
+  inline void swap_bytes_impl(void* a, void* b, std::size_t n) noexcept
+  {
+    unsigned char buffer[256];
+    auto* x = static_cast<unsigned char*>(a);
+    auto* y = static_cast<unsigned char*>(b);
+    for (std::size_t k; n > 0; x += k, y += k, n -= k) {
+      k = n < sizeof buffer ? n : sizeof buffer;
+      std::memcpy(buffer, x, k);
+      std::memcpy(x, y, k);
+      std::memcpy(y, buffer, k);
+    }
+  }
+
+  // Calls f(std::integral_constant<std::size_t, I>{}) for I in [0, N).
+  template<std::size_t N, typename F>
+    constexpr void unroll_impl(F&& f)
+    {
+      [&]<std::size_t... I>(std::index_sequence<I...>) {
+        (f(std::integral_constant<std::size_t, I>{}), ...);
+      }(std::make_index_sequence<N>{});
+    }
+
   // Template alias for nested std::initializer_lists 
   template<typename T, std::size_t M, std::size_t... N>
     struct Nested_initializer_impl {
@@ -82,15 +193,21 @@ namespace tb {
 
   // Primary template class for multi_array.
   template<typename T, std::size_t M, std::size_t... N>
-    class multi_array {
+    class multi_array TB_MULTI_ARRAY_REGISTERED(multi_array<T, M, N...>) {
     public:
+      using element_type           = T;
       using value_type             = multi_array<T, N...>;
       using pointer                = value_type*;
       using const_pointer          = const value_type*;
       using reference              = value_type&;
       using const_reference        = const value_type&;
+#ifdef TB_MULTI_ARRAY_TRACE
+      using iterator       = traced_iterator<value_type, multi_array>;
+      using const_iterator = traced_iterator<const value_type, multi_array>;
+#else
       using iterator               = value_type*;
       using const_iterator         = const value_type*;
+#endif
       using size_type              = std::size_t;
       using difference_type        = std::ptrdiff_t;
       using reverse_iterator       = std::reverse_iterator<iterator>;
@@ -103,63 +220,96 @@ namespace tb {
       
       static consteval auto order() { return sizeof...(N) + 1; }
 
-      //static consteval auto total_size() { return (M * ... * N); }
+      static consteval auto total_size() { return (M * ... * N); }
 
 
       constexpr multi_array() = default;
+#ifdef TB_MULTI_ARRAY_TRACE
+      // Accesses through arrays later created in this storage are not
+      // accesses through this array.
+      constexpr ~multi_array()
+      { if (!std::is_constant_evaluated()) trace_forget(this, sizeof *this); }
+#endif
+#ifdef TB_MULTI_ARRAY_OBSERVED_COPIES
+      constexpr multi_array(const multi_array& a)
+        TB_MULTI_ARRAY_REGISTER(multi_array<T, M, N...>)
+      {
+        TB_MULTI_ARRAY_COPIED(construct);
+        TB_MULTI_ARRAY_TIMED(copy);
+        copy_from(a);
+      }
+
+      constexpr multi_array& operator=(const multi_array& a)
+      {
+        TB_MULTI_ARRAY_COPIED(assign);
+        TB_MULTI_ARRAY_TIMED(copy);
+        if (this != &a) copy_from(a);
+        return *this;
+      }
+#else
       constexpr multi_array(const multi_array&) = default;
+      constexpr multi_array(multi_array&&) = default;
+      constexpr multi_array& operator=(const multi_array&) = default;
+      constexpr multi_array& operator=(multi_array&&) = default;
+#endif
 
       constexpr multi_array(const T& value)
-      { std::fill(begin(), end(), value); }
+      {
+        TB_MULTI_ARRAY_UNCOUNTED;
+        TB_MULTI_ARRAY_UNTIMED;
+        std::fill(sub_array_, sub_array_ + M, value);
+      }
       
       constexpr multi_array(const Nested_initializer<T, M, N...>& init_list)
       {
+        TB_MULTI_ARRAY_UNCOUNTED;
+        TB_MULTI_ARRAY_UNTIMED;
         assert(init_list.size() == M);
         std::copy(init_list.begin(), init_list.end(), sub_array_);
       }
 
       constexpr reference operator[](std::size_t i) noexcept 
-      { return sub_array_[i]; }
+      { return TB_MULTI_ARRAY_TRACED(subscript, sub_array_[i]); }
       constexpr const_reference operator[](std::size_t i) const noexcept 
-      { return sub_array_[i]; }
+      { return TB_MULTI_ARRAY_TRACED(subscript, sub_array_[i]); }
 
       template<Index_type Index, Index_type... Indices>
         constexpr auto& operator()(Index i, Indices... j) noexcept 
           requires (sizeof...(Indices) + 1 == order())//(sizeof...(Indices) < order())
-        { return sub_array_[i](j...); }
+        { return TB_MULTI_ARRAY_TRACED(call, sub_array_[i](j...)); }
 
       template<Index_type Index, Index_type... Indices>
         constexpr auto& operator()(Index i, Indices... j) const noexcept
           requires (sizeof...(Indices) + 1 == order())
-        { return sub_array_[i](j...); }
+        { return TB_MULTI_ARRAY_TRACED(call, sub_array_[i](j...)); }
 
       template<Index_type Index, Index_type... Indices>
         constexpr auto& at(Index i, Indices... j) noexcept 
           requires (sizeof...(Indices) + 1 == order())
-        { assert(i < M); return sub_array_[i](j...); }
+        { assert(i < M); return TB_MULTI_ARRAY_TRACED(at, sub_array_[i](j...)); }
 
       template<Index_type Index, Index_type... Indices>
         constexpr auto& at(Index i, Indices... j) const noexcept
           requires (sizeof...(Indices) + 1 == order())
-        { assert(i < M); return sub_array_[i](j...); }
+        { assert(i < M); return TB_MULTI_ARRAY_TRACED(at, sub_array_[i](j...)); }
 
       constexpr iterator begin() noexcept 
-      { return iterator(sub_array_); }
+      { return TB_MULTI_ARRAY_ITERATOR(iterator, sub_array_); }
       
       constexpr const_iterator begin() const noexcept  
-      { return const_iterator(sub_array_); }
+      { return TB_MULTI_ARRAY_ITERATOR(const_iterator, sub_array_); }
       
       constexpr const_iterator cbegin() const noexcept 
-      { return const_iterator(sub_array_); }
+      { return TB_MULTI_ARRAY_ITERATOR(const_iterator, sub_array_); }
 
       constexpr iterator end() noexcept 
-      { return iterator(sub_array_ + M); }
+      { return TB_MULTI_ARRAY_ITERATOR(iterator, sub_array_ + M); }
       
       constexpr const_iterator end() const noexcept  
-      { return const_iterator(sub_array_ + M); }
+      { return TB_MULTI_ARRAY_ITERATOR(const_iterator, sub_array_ + M); }
       
       constexpr const_iterator cend() const noexcept 
-      { return const_iterator(sub_array_ + M); }
+      { return TB_MULTI_ARRAY_ITERATOR(const_iterator, sub_array_ + M); }
 
       constexpr iterator rbegin() noexcept
       { return reverse_iterator(end()); }
@@ -198,26 +348,96 @@ namespace tb {
       { return sub_array_->data(); }
 
       constexpr void fill(const T& value)
-      { std::fill(begin(), end(), value); }
+      {
+        TB_MULTI_ARRAY_UNCOUNTED;
+        TB_MULTI_ARRAY_TIMED(fill);
+        if constexpr (total_size() <= unroll_limit) {
+          // A copy, so that stores through sub_array_ cannot alias value.
+          const T v = value;
+          unroll_impl<M>([&](auto i) { sub_array_[i].fill(v); });
+        } else {
+          // Arrays larger than the cache are written around it.
+          if constexpr (std::is_trivially_copyable_v<T>)
+            if (!std::is_constant_evaluated() && sizeof sub_array_ >= stream_threshold())
+              return stream_fill_impl(data(), total_size(), value);
+          std::fill(sub_array_, sub_array_ + M, value);
+        }
+      }
 
       constexpr void swap(multi_array& a) noexcept
-      { std::swap_ranges(begin(), end(), a.begin()); }
+      {
+        TB_MULTI_ARRAY_COPIED(swap);
+        TB_MULTI_ARRAY_TIMED(swap);
+        if constexpr (total_size() <= unroll_limit && std::is_trivially_copyable_v<T>) {
+          // Whole copies load every element before storing any, which the
+          // compiler cannot arrange across element swaps that may overlap.
+          const multi_array t = a;
+          a = *this;
+          *this = t;
+        } else if constexpr (total_size() <= unroll_limit)
+          unroll_impl<M>([&](auto i) { sub_array_[i].swap(a.sub_array_[i]); });
+        else if (is_trivially_relocatable_v<T> && !std::is_constant_evaluated()) {
+          // Elements that can be relocated with memcpy can be exchanged
+          // with it, even when they cannot be copied with it.
+          if (this == &a) return;
+          if (sizeof sub_array_ >= stream_threshold())
+            stream_swap_bytes_impl(reinterpret_cast<char*>(sub_array_),
+                                   reinterpret_cast<char*>(a.sub_array_), sizeof sub_array_);
+          else
+            swap_bytes_impl(sub_array_, a.sub_array_, sizeof sub_array_);
+        } else
+          std::swap_ranges(sub_array_, sub_array_ + M, a.sub_array_);
+      }
 
     private:
+#ifdef TB_MULTI_ARRAY_OBSERVED_COPIES
+      constexpr void copy_from(const multi_array& a)
+      {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+          if (!std::is_constant_evaluated()) {
+            std::memcpy(data(), a.data(), total_size() * sizeof(T));
+            return;
+          }
+        }
+        std::copy(a.sub_array_, a.sub_array_ + M, sub_array_);
+      }
+#endif
+
       multi_array<T, N...> sub_array_[M];
+
+#ifdef TB_MULTI_ARRAY_TRIVIAL_COPIES
+      // Rows add nothing to their elements' storage, so arrays of trivial
+      // types may be copied and relocated with memcpy. Checked for every
+      // row type, which is complete here; the outermost array is the same
+      // template around an array of rows, checked once below.
+      static_assert(!std::is_trivial_v<T>
+                    || (std::is_trivial_v<value_type>
+                        && is_trivially_relocatable_v<value_type>
+                        && std::is_nothrow_move_constructible_v<value_type>));
+      static_assert(!std::is_trivially_copyable_v<T>
+                    || std::is_trivially_copyable_v<value_type>);
+      static_assert(!std::is_standard_layout_v<T> || std::is_standard_layout_v<value_type>);
+      static_assert(sizeof(value_type) == sizeof(T) * value_type::total_size());
+#endif
     };
 
   // Specialization template class for multi_arrays of order/rank = 1
   template<typename T, std::size_t N>
-    class multi_array<T, N> {
+    class multi_array<T, N> TB_MULTI_ARRAY_REGISTERED(multi_array<T, N>) {
     public:
+      using element_type           = T;
       using value_type             = T;
       using pointer                = value_type*;
       using const_pointer          = const value_type*;
       using reference              = value_type&;
       using const_reference        = const value_type&;
+#ifdef TB_MULTI_ARRAY_TRACE
+      using iterator       = traced_iterator<value_type, multi_array>;
+      using const_iterator = traced_iterator<const value_type, multi_array>;
+#else
       using iterator               = value_type*;
       using const_iterator         = const value_type*;
+#endif
       using size_type              = std::size_t;
       using difference_type        = std::ptrdiff_t;
       using reverse_iterator       = std::reverse_iterator<iterator>;
@@ -229,53 +449,76 @@ namespace tb {
 
       static consteval auto order() { return 1; }
 
+      static consteval auto total_size() { return N; }
+
       constexpr multi_array() = default;
+#ifdef TB_MULTI_ARRAY_OBSERVED_COPIES
+      constexpr multi_array(const multi_array& a)
+        TB_MULTI_ARRAY_REGISTER(multi_array<T, N>)
+      {
+        TB_MULTI_ARRAY_COPIED(construct);
+        TB_MULTI_ARRAY_TIMED(copy);
+        copy_from(a);
+      }
+
+      constexpr multi_array& operator=(const multi_array& a)
+      {
+        TB_MULTI_ARRAY_COPIED(assign);
+        TB_MULTI_ARRAY_TIMED(copy);
+        if (this != &a) copy_from(a);
+        return *this;
+      }
+#else
       constexpr multi_array(const multi_array&) = default;
+      constexpr multi_array(multi_array&&) = default;
+      constexpr multi_array& operator=(const multi_array&) = default;
+      constexpr multi_array& operator=(multi_array&&) = default;
+#endif
       
       constexpr multi_array(const T& value) 
-      { std::fill(begin(), end(), value); }
+      { std::fill(sub_array_, sub_array_ + N, value); }
 
       constexpr multi_array(const std::initializer_list<T>& initializer)
       { 
         assert(initializer.size() == N); 
-        std::copy(initializer.begin(), initializer.end(), begin());
+        std::copy(initializer.begin(), initializer.end(), sub_array_);
       }
 
       constexpr reference operator[](std::size_t i) noexcept
-      { return sub_array_[i]; }
+      { return TB_MULTI_ARRAY_TRACED(subscript, sub_array_[i]); }
       constexpr const_reference operator[](std::size_t i) const noexcept 
-      { return sub_array_[i]; }
+      { return TB_MULTI_ARRAY_TRACED(subscript, sub_array_[i]); }
 
       constexpr reference operator()(std::size_t i) noexcept 
-      { return sub_array_[i]; }
+      { return TB_MULTI_ARRAY_TRACED(call, sub_array_[i]); }
       constexpr const_reference operator()(std::size_t i) const noexcept 
-      { return sub_array_[i]; }
+      { return TB_MULTI_ARRAY_TRACED(call, sub_array_[i]); }
 
       constexpr reference at(std::size_t i) noexcept 
-      { assert(i < N); return sub_array_[i]; }
+      { assert(i < N); return TB_MULTI_ARRAY_TRACED(at, sub_array_[i]); }
       constexpr const_reference at(std::size_t i) const noexcept 
-      { assert(i < N); return sub_array_[i]; }
+      { assert(i < N); return TB_MULTI_ARRAY_TRACED(at, sub_array_[i]); }
 
       //constexpr auto& operator()(void) noexcept { return *this; }
       //constexpr auto& operator()(void) const noexcept { return *this; }
 
       constexpr iterator begin() noexcept 
-      { return iterator(sub_array_); }
+      { return TB_MULTI_ARRAY_ITERATOR(iterator, sub_array_); }
       
       constexpr const_iterator begin() const noexcept  
-      { return const_iterator(sub_array_); }
+      { return TB_MULTI_ARRAY_ITERATOR(const_iterator, sub_array_); }
       
       constexpr const_iterator cbegin() const noexcept 
-      { return const_iterator(sub_array_); }
+      { return TB_MULTI_ARRAY_ITERATOR(const_iterator, sub_array_); }
 
       constexpr iterator end() noexcept 
-      { return iterator(sub_array_ + N); }
+      { return TB_MULTI_ARRAY_ITERATOR(iterator, sub_array_ + N); }
       
       constexpr const_iterator end() const noexcept  
-      { return const_iterator(sub_array_ + N); }
+      { return TB_MULTI_ARRAY_ITERATOR(const_iterator, sub_array_ + N); }
       
       constexpr const_iterator cend() const noexcept 
-      { return const_iterator(sub_array_ + N); }
+      { return TB_MULTI_ARRAY_ITERATOR(const_iterator, sub_array_ + N); }
 
       constexpr iterator rbegin() noexcept
       { return reverse_iterator(end()); }
@@ -314,12 +557,63 @@ namespace tb {
       { return sub_array_; }
 
       constexpr void fill(const T& value) noexcept
-      { std::fill(begin(), end(), value); }
+      {
+        TB_MULTI_ARRAY_TIMED(fill);
+        if constexpr (N <= unroll_limit) {
+          // A copy, so that stores through sub_array_ cannot alias value.
+          const T v = value;
+          unroll_impl<N>([&](auto i) { sub_array_[i] = v; });
+        } else {
+          // Arrays larger than the cache are written around it.
+          if constexpr (std::is_trivially_copyable_v<T>)
+            if (!std::is_constant_evaluated() && sizeof sub_array_ >= stream_threshold())
+              return stream_fill_impl(data(), total_size(), value);
+          std::fill(sub_array_, sub_array_ + N, value);
+        }
+      }
 
       constexpr void swap(multi_array& a) noexcept
-      { std::swap_ranges(begin(), end(), a.begin()); }
+      {
+        TB_MULTI_ARRAY_COPIED(swap);
+        TB_MULTI_ARRAY_TIMED(swap);
+        if constexpr (N <= unroll_limit && std::is_trivially_copyable_v<T>) {
+          // Whole copies load every element before storing any, which the
+          // compiler cannot arrange across element swaps that may overlap.
+          const multi_array t = a;
+          a = *this;
+          *this = t;
+        } else if constexpr (N <= unroll_limit)
+          unroll_impl<N>([&](auto i) {
+            using std::swap;
+            swap(sub_array_[i], a.sub_array_[i]);
+          });
+        else if (is_trivially_relocatable_v<T> && !std::is_constant_evaluated()) {
+          // Elements that can be relocated with memcpy can be exchanged
+          // with it, even when they cannot be copied with it.
+          if (this == &a) return;
+          if (sizeof sub_array_ >= stream_threshold())
+            stream_swap_bytes_impl(reinterpret_cast<char*>(sub_array_),
+                                   reinterpret_cast<char*>(a.sub_array_), sizeof sub_array_);
+          else
+            swap_bytes_impl(sub_array_, a.sub_array_, sizeof sub_array_);
+        } else
+          std::swap_ranges(sub_array_, sub_array_ + N, a.sub_array_);
+      }
 
     private:
+#ifdef TB_MULTI_ARRAY_OBSERVED_COPIES
+      constexpr void copy_from(const multi_array& a)
+      {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+          if (!std::is_constant_evaluated()) {
+            std::memcpy(data(), a.data(), total_size() * sizeof(T));
+            return;
+          }
+        }
+        std::copy(a.sub_array_, a.sub_array_ + N, sub_array_);
+      }
+#endif
+
       T sub_array_[N];
     };
 
@@ -337,23 +631,73 @@ namespace tb {
     using multi_array_for 
       = multi_array_for_impl<T, std::make_index_sequence<std::rank_v<T>>>::type; 
 
+  // Type predicate for multi_array specializations
+  template<typename T>
+    struct is_multi_array : std::false_type {};
+
+  template<typename T, std::size_t M, std::size_t... N>
+    struct is_multi_array<multi_array<T, M, N...>> : std::true_type {};
+
+  template<typename T>
+    concept Multi_array = is_multi_array<std::remove_cv_t<T>>::value;
+
+  // A multi_array is relocatable whenever its elements are, except when
+  // instances are registered or traced by address.
+  template<typename T, std::size_t M, std::size_t... N>
+    struct is_trivially_relocatable<multi_array<T, M, N...>>
+#if defined(TB_MULTI_ARRAY_MEMORY_REGISTRY) || defined(TB_MULTI_ARRAY_TRACE)
+      : std::false_type {};
+#else
+      : is_trivially_relocatable<T> {};
+#endif
+
+#ifdef TB_MULTI_ARRAY_TRIVIAL_COPIES
+  // The same for whole arrays, which are not rows of another array.
+  static_assert(std::is_trivial_v<multi_array<float, 4>>);
+  static_assert(std::is_trivial_v<multi_array<double, 4, 4>>);
+  static_assert(std::is_trivially_copyable_v<multi_array<int, 2, 3, 4>>);
+  static_assert(std::is_standard_layout_v<multi_array<int, 2, 3, 4>>);
+  static_assert(sizeof(multi_array<int, 2, 3, 4>) == sizeof(int[2][3][4]));
+  static_assert(is_trivially_relocatable_v<multi_array<float, 3, 3>>);
+  static_assert(std::is_nothrow_move_constructible_v<multi_array<std::size_t*, 2, 2>>);
+#endif
+
+  // Type function for the extent of the innermost (contiguous) dimension
+  template<typename T>
+    struct innermost_extent : innermost_extent<typename T::value_type> {};
+
+  template<typename T, std::size_t N>
+    struct innermost_extent<multi_array<T, N>> 
+      : std::integral_constant<std::size_t, N> {};
+
+  template<typename T>
+    inline constexpr std::size_t innermost_extent_v 
+      = innermost_extent<T>::value;
+
   // Comparison operator to test for equivalency
   template<typename T, std::size_t M, std::size_t... N>
     constexpr bool
-    operator==(const multi_array<T, M, N...> lhs, 
-              const multi_array<T, M, N...> rhs)
+    operator==(const multi_array<T, M, N...>& lhs, 
+              const multi_array<T, M, N...>& rhs)
     {
-      for (std::size_t i = 0; i < M; ++i) {
-        if (lhs[i] != rhs[i]) return false;
+      if constexpr (multi_array<T, M, N...>::total_size() <= unroll_limit) {
+        // Without early exits, so that the comparisons can be vectorized.
+        return [&]<std::size_t... I>(std::index_sequence<I...>) {
+          return (static_cast<bool>(lhs[I] == rhs[I]) & ...);
+        }(std::make_index_sequence<M>{});
+      } else {
+        for (std::size_t i = 0; i < M; ++i) {
+          if (lhs[i] != rhs[i]) return false;
+        }
+        return true;
       }
-      return true;
     }
 
   // Comparison operator to test when not equivalent
   template<typename T, std::size_t M, std::size_t... N>
     constexpr bool
-    operator!=(const multi_array<T, M, N...> lhs, 
-              const multi_array<T, M, N...> rhs)
+    operator!=(const multi_array<T, M, N...>& lhs, 
+              const multi_array<T, M, N...>& rhs)
     { return !(lhs == rhs); }
  
   // Extracts the I-th element from the array using tuple-like interface.
@@ -385,6 +729,41 @@ namespace tb {
                         multi_array<T, M, N...>& rhs) noexcept
     { lhs.swap(rhs); }
 
+  // Implementation for transform(): out[i...] = f(a[i...], b[i...]...)
+  template<typename U, typename F, std::size_t M, std::size_t... N, typename... A>
+    constexpr void
+    transform_impl(multi_array<U, M, N...>& out, F& f, const A&... a)
+    {
+      auto apply = [&](std::size_t i) {
+        if constexpr (sizeof...(N) == 0) out[i] = f(a[i]...);
+        else transform_impl(out[i], f, a[i]...);
+      };
+      if constexpr (multi_array<U, M, N...>::total_size() <= unroll_limit)
+        unroll_impl<M>(apply);
+      else
+        for (std::size_t i = 0; i < M; ++i) apply(i);
+    }
+
+  // Returns the array of f(x) for each element x of a.
+  template<typename T, std::size_t M, std::size_t... N, typename F>
+    constexpr auto
+    transform(const multi_array<T, M, N...>& a, F f)
+    {
+      multi_array<std::invoke_result_t<F&, const T&>, M, N...> result;
+      transform_impl(result, f, a);
+      return result;
+    }
+
+  // Returns the array of f(x, y) for each pair of corresponding elements.
+  template<typename T, typename U, std::size_t M, std::size_t... N, typename F>
+    constexpr auto
+    transform(const multi_array<T, M, N...>& a, const multi_array<U, M, N...>& b, F f)
+    {
+      multi_array<std::invoke_result_t<F&, const T&, const U&>, M, N...> result;
+      transform_impl(result, f, a, b);
+      return result;
+    }
+
   // Creates a multi_array from a built-in array
   template<typename T, typename R = std::remove_all_extents_t<T>>
     constexpr auto
@@ -395,19 +774,30 @@ namespace tb {
       return result;
     }
 
+  // Type function for the extents of a multi_array, outermost first
+  template<typename T>
+    struct multi_array_extents;
+
   template<typename T, std::size_t M, std::size_t... N>
-    consteval auto
-    extents(const multi_array<T, M, N...>& a)
-    {
+    struct multi_array_extents<multi_array<T, M, N...>> {
+      static constexpr std::array<std::size_t, sizeof...(N) + 1> value{ M, N... };
+    };
 
-    }
+  template<typename T>
+    inline constexpr auto multi_array_extents_v 
+      = multi_array_extents<std::remove_cv_t<T>>::value;
+
+  // Returns the extent of every dimension, outermost first.
+  template<typename T, std::size_t M, std::size_t... N>
+    constexpr auto
+    extents(const multi_array<T, M, N...>&) noexcept
+    { return multi_array_extents<multi_array<T, M, N...>>::value; }
   
 
-  /*
+  // Returns the total number of elements in a multi_array.
   template<typename T, std::size_t M, std::size_t... N>
     auto constexpr array_size(const multi_array<T, M, N...>&)
     { return (M * ... * N); }
-  */
 
 } // namespace tb
 #endif//TB_MULTI_ARRAY_H
\ No newline at end of file
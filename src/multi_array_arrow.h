@@ -0,0 +1,418 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef TB_MULTI_ARRAY_ARROW_H
+#define TB_MULTI_ARRAY_ARROW_H
+
+#include "multi_array.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Reads and writes multi_arrays as Apache Arrow Tensor IPC messages:
+//
+//   uint32_t continuation  0xFFFFFFFF
+//   int32_t  length        size of the flatbuffer metadata plus padding
+//   uint8_t  metadata[]    flatbuffer Message { header: Tensor }
+//   uint8_t  body[]        row-major element data, 64-byte aligned
+//
+// The flatbuffer tables are encoded by hand, so no Arrow or flatbuffers
+// dependency is needed. Only little-endian hosts are supported, as in Arrow.
+
+namespace tb {
+
+  template<typename T>
+    concept Arrow_element = std::is_arithmetic_v<T> && !std::is_same_v<T, bool>
+      && (sizeof(T) <= 8) && (std::is_integral_v<T> || sizeof(T) >= 4);
+
+  // Alignment of the tensor body within the message.
+  inline constexpr std::size_t arrow_alignment = 64;
+
+  // Minimal forward-only flatbuffer encoder. Objects are written in order and
+  // every reference points to an object written after it, which keeps the
+  // unsigned flatbuffer offsets valid without building back-to-front.
+  class flatbuffer_writer_impl {
+  public:
+    struct field {
+      std::uint16_t id;
+      std::uint8_t size;
+      std::uint64_t value[2] = {};
+      std::size_t at = 0;  // absolute position once written
+    };
+
+    std::size_t pos() const noexcept { return buf_.size(); }
+
+    void pad_to(std::size_t align)
+    { buf_.resize((buf_.size() + align - 1) / align * align, 0); }
+
+    template<typename T>
+      std::size_t put(T v)
+      {
+        pad_to(sizeof(T));
+        const std::size_t at = pos();
+        buf_.resize(at + sizeof(T));
+        std::memcpy(buf_.data() + at, &v, sizeof(T));
+        return at;
+      }
+
+    // Points the uoffset stored at `at` to target.
+    void link(std::size_t at, std::size_t target)
+    {
+      const auto off = static_cast<std::uint32_t>(target - at);
+      std::memcpy(buf_.data() + at, &off, sizeof off);
+    }
+
+    // Writes a vtable and table with the given fields. Unset offset fields
+    // are left zero for link(). Returns the table position.
+    std::size_t table(field* first, field* last)
+    {
+      std::size_t rel[16] = {};
+      std::uint16_t ids = 0;
+      std::size_t size = 4;
+      for (std::size_t align : {8, 4, 2, 1})
+        for (field* f = first; f != last; ++f)
+          if (std::min<std::size_t>(f->size, 8) == align) {
+            size = (size + align - 1) / align * align;
+            rel[f->id] = size;
+            size += f->size;
+            ids = std::max<std::uint16_t>(ids, f->id + 1);
+          }
+
+      pad_to(2);
+      const std::size_t vt = pos();
+      put<std::uint16_t>(static_cast<std::uint16_t>(4 + 2 * ids));
+      put<std::uint16_t>(static_cast<std::uint16_t>(size));
+      for (std::uint16_t i = 0; i < ids; ++i)
+        put<std::uint16_t>(static_cast<std::uint16_t>(rel[i]));
+
+      pad_to(8);
+      const std::size_t tp = pos();
+      buf_.resize(tp + size, 0);
+      const auto back = static_cast<std::int32_t>(tp - vt);
+      std::memcpy(buf_.data() + tp, &back, sizeof back);
+      for (field* f = first; f != last; ++f) {
+        f->at = tp + rel[f->id];
+        std::memcpy(buf_.data() + f->at, f->value, f->size);
+      }
+      return tp;
+    }
+
+    // Writes the length of a vector whose elements are elem_size bytes and
+    // returns its position; elements are then written with put().
+    std::size_t vector(std::uint32_t count, std::size_t elem_size)
+    {
+      // The length immediately precedes the first, aligned, element.
+      const std::size_t align = std::max<std::size_t>(elem_size, 4);
+      while ((pos() + 4) % align != 0) buf_.push_back(0);
+      return put<std::uint32_t>(count);
+    }
+
+    std::vector<unsigned char>& bytes() noexcept { return buf_; }
+
+  private:
+    std::vector<unsigned char> buf_;
+  };
+
+  // Builds the flatbuffer Message describing a tensor of type A.
+  template<Multi_array A>
+    std::vector<unsigned char> arrow_tensor_metadata_impl()
+    {
+      using T = typename A::element_type;
+      using field = flatbuffer_writer_impl::field;
+      constexpr auto dims = multi_array_extents_v<A>;
+      constexpr std::uint64_t body = A::total_size() * sizeof(T);
+
+      flatbuffer_writer_impl fb;
+      const std::size_t root = fb.put<std::uint32_t>(0);
+
+      // Message { version: V5, header_type: Tensor, header, bodyLength }
+      field message[] = {
+        { 0, 2, { 4 } }, { 1, 1, { 4 } }, { 2, 4 }, { 3, 8, { body } }
+      };
+      fb.link(root, fb.table(std::begin(message), std::end(message)));
+
+      // Tensor { type_type, type, shape, strides, data: Buffer }
+      const std::uint8_t type_type = std::is_floating_point_v<T> ? 3 : 2;
+      field tensor[] = {
+        { 0, 1, { type_type } }, { 1, 4 }, { 2, 4 }, { 3, 4 },
+        { 4, 16, { 0, body } }
+      };
+      fb.link(message[2].at, fb.table(std::begin(tensor), std::end(tensor)));
+
+      // Int { bitWidth, is_signed } or FloatingPoint { precision }
+      if constexpr (std::is_floating_point_v<T>) {
+        field type[] = { { 0, 2, { sizeof(T) == 4 ? 1u : 2u } } };
+        fb.link(tensor[1].at, fb.table(std::begin(type), std::end(type)));
+      } else {
+        field type[] = {
+          { 0, 4, { sizeof(T) * 8 } }, { 1, 1, { std::is_signed_v<T> } }
+        };
+        fb.link(tensor[1].at, fb.table(std::begin(type), std::end(type)));
+      }
+
+      // shape: [TensorDim { size }]
+      fb.link(tensor[2].at, fb.vector(A::order(), 4));
+      std::size_t slots[A::order()];
+      for (std::size_t i = 0; i < A::order(); ++i)
+        slots[i] = fb.put<std::uint32_t>(0);
+      for (std::size_t i = 0; i < A::order(); ++i) {
+        field dim[] = { { 0, 8, { dims[i] } } };
+        fb.link(slots[i], fb.table(std::begin(dim), std::end(dim)));
+      }
+
+      // strides: [long], in bytes
+      fb.link(tensor[3].at, fb.vector(A::order(), 8));
+      std::int64_t stride = sizeof(T);
+      std::int64_t strides[A::order()];
+      for (std::size_t i = A::order(); i-- > 0; ) {
+        strides[i] = stride;
+        stride *= static_cast<std::int64_t>(dims[i]);
+      }
+      for (auto s : strides) fb.put<std::int64_t>(s);
+
+      // Pad so that the body following the 8-byte prefix is aligned.
+      auto& bytes = fb.bytes();
+      bytes.resize((bytes.size() + 8 + arrow_alignment - 1) / arrow_alignment
+                   * arrow_alignment - 8, 0);
+      return std::move(bytes);
+    }
+
+  // Bounds-checked flatbuffer reader.
+  class flatbuffer_reader_impl {
+  public:
+    flatbuffer_reader_impl(const unsigned char* p, std::size_t n) noexcept
+      : p_(p), n_(n) {}
+
+    template<typename T>
+      T get(std::size_t at) const
+      {
+        if (at > n_ || n_ - at < sizeof(T))
+          throw std::runtime_error("multi_array: corrupt Arrow metadata");
+        T v;
+        std::memcpy(&v, p_ + at, sizeof v);
+        return v;
+      }
+
+    std::size_t deref(std::size_t at) const
+    { return at + get<std::uint32_t>(at); }
+
+    // Position of field id of the table at t, or 0 when absent.
+    std::size_t field(std::size_t t, std::uint16_t id) const
+    {
+      const std::size_t vt = t - get<std::int32_t>(t);
+      const std::uint16_t vt_size = get<std::uint16_t>(vt);
+      if (4u + 2u * id >= vt_size) return 0;
+      const std::uint16_t off = get<std::uint16_t>(vt + 4 + 2 * id);
+      return off ? t + off : 0;
+    }
+
+    template<typename T>
+      T scalar(std::size_t t, std::uint16_t id, T fallback = {}) const
+      {
+        const std::size_t f = field(t, id);
+        return f ? get<T>(f) : fallback;
+      }
+
+    std::size_t object(std::size_t t, std::uint16_t id) const
+    {
+      const std::size_t f = field(t, id);
+      return f ? deref(f) : 0;
+    }
+
+  private:
+    const unsigned char* p_;
+    std::size_t n_;
+  };
+
+  // Checks that the metadata describes a tensor of type A and returns the
+  // byte offset of its data within the message body.
+  template<Multi_array A>
+    std::uint64_t parse_arrow_tensor_impl(const unsigned char* meta,
+                                          std::size_t size)
+    {
+      using T = typename A::element_type;
+      constexpr auto dims = multi_array_extents_v<A>;
+      flatbuffer_reader_impl fb(meta, size);
+      auto fail = [](const char* what) {
+        throw std::runtime_error(std::string("multi_array: Arrow ") + what);
+      };
+
+      const std::size_t message = fb.deref(0);
+      if (fb.scalar<std::uint8_t>(message, 1) != 4) fail("message is not a tensor");
+      const std::size_t tensor = fb.object(message, 2);
+      if (!tensor) fail("tensor header missing");
+
+      const std::size_t type = fb.object(tensor, 1);
+      if (!type) fail("tensor type missing");
+      const auto type_type = fb.scalar<std::uint8_t>(tensor, 0);
+      if constexpr (std::is_floating_point_v<T>) {
+        if (type_type != 3
+            || fb.scalar<std::int16_t>(type, 0) != (sizeof(T) == 4 ? 1 : 2))
+          fail("tensor type mismatch");
+      } else {
+        if (type_type != 2
+            || fb.scalar<std::int32_t>(type, 0) != int(sizeof(T) * 8)
+            || fb.scalar<std::uint8_t>(type, 1) != std::is_signed_v<T>)
+          fail("tensor type mismatch");
+      }
+
+      const std::size_t shape = fb.object(tensor, 2);
+      if (!shape || fb.get<std::uint32_t>(shape) != A::order())
+        fail("tensor rank mismatch");
+      for (std::size_t i = 0; i < A::order(); ++i) {
+        const std::size_t dim = fb.deref(shape + 4 + 4 * i);
+        if (fb.scalar<std::int64_t>(dim, 0) != static_cast<std::int64_t>(dims[i]))
+          fail("tensor shape mismatch");
+      }
+
+      if (const std::size_t strides = fb.object(tensor, 3)) {
+        if (fb.get<std::uint32_t>(strides) != A::order())
+          fail("tensor strides mismatch");
+        std::int64_t stride = sizeof(T);
+        for (std::size_t i = A::order(); i-- > 0; ) {
+          if (dims[i] > 1 && fb.get<std::int64_t>(strides + 4 + 8 * i) != stride)
+            fail("tensor is not row-major");
+          stride *= static_cast<std::int64_t>(dims[i]);
+        }
+      }
+
+      const std::size_t data = fb.field(tensor, 4);
+      if (!data) fail("tensor data missing");
+      if (fb.get<std::uint64_t>(data + 8) != A::total_size() * sizeof(T))
+        fail("tensor data size mismatch");
+      return fb.get<std::uint64_t>(data);
+    }
+
+  // Writes a as an Arrow Tensor IPC message.
+  template<Multi_array A>
+      requires Arrow_element<typename A::element_type>
+    void save_arrow_tensor(const std::filesystem::path& path, const A& a)
+    {
+      TB_MULTI_ARRAY_TIMED(save_arrow);
+      TB_MULTI_ARRAY_SPAN("io", "save_arrow_tensor", static_cast<std::int64_t>(sizeof(A)));
+      static_assert(std::endian::native == std::endian::little);
+      using T = typename A::element_type;
+      const auto meta = arrow_tensor_metadata_impl<A>();
+      const std::uint32_t prefix[2] = {
+        0xFFFFFFFFu, static_cast<std::uint32_t>(meta.size())
+      };
+      const std::size_t n = A::total_size();
+      const std::size_t pad = (8 - n * sizeof(T) % 8) % 8;
+      const unsigned char zeros[8] = {};
+
+      std::FILE* f = std::fopen(path.string().c_str(), "wb");
+      if (!f)
+        throw std::runtime_error("multi_array: cannot open " + path.string());
+      bool ok = std::fwrite(prefix, sizeof prefix, 1, f) == 1
+             && std::fwrite(meta.data(), 1, meta.size(), f) == meta.size()
+             && std::fwrite(a.data(), sizeof(T), n, f) == n
+             && std::fwrite(zeros, 1, pad, f) == pad;
+      if (std::fclose(f) != 0 || !ok)
+        throw std::runtime_error("multi_array: cannot write " + path.string());
+    }
+
+  // Views an Arrow Tensor IPC message held in memory (e.g. a mapped file)
+  // as a multi_array without copying. Throws std::runtime_error if the
+  // message does not describe a compact row-major tensor of type A.
+  template<Multi_array A>
+      requires Arrow_element<typename A::element_type>
+    const A& arrow_tensor_view(const void* message, std::size_t size)
+    {
+      static_assert(std::endian::native == std::endian::little);
+      const auto* p = static_cast<const unsigned char*>(message);
+      std::uint32_t prefix[2];
+      if (size < sizeof prefix)
+        throw std::runtime_error("multi_array: truncated Arrow message");
+      std::memcpy(prefix, p, sizeof prefix);
+      const std::size_t skip = prefix[0] == 0xFFFFFFFFu ? 8 : 4;
+      const std::size_t meta = skip == 8 ? prefix[1] : prefix[0];
+      if (size - skip < meta)
+        throw std::runtime_error("multi_array: truncated Arrow message");
+      const std::uint64_t offset = parse_arrow_tensor_impl<A>(p + skip, meta);
+      const std::size_t body = skip + meta;
+      if (offset > size - body || size - body - offset < sizeof(A))
+        throw std::runtime_error("multi_array: truncated Arrow message");
+      const void* data = p + body + offset;
+      if (reinterpret_cast<std::uintptr_t>(data) % alignof(A) != 0)
+        throw std::runtime_error("multi_array: misaligned Arrow tensor data");
+      return *static_cast<const A*>(data);
+    }
+
+  // Reads an Arrow Tensor IPC message from a file into a new multi_array.
+  template<Multi_array A>
+      requires Arrow_element<typename A::element_type>
+    A load_arrow_tensor(const std::filesystem::path& path)
+    {
+      TB_MULTI_ARRAY_TIMED(load_arrow);
+      TB_MULTI_ARRAY_SPAN("io", "load_arrow_tensor", static_cast<std::int64_t>(sizeof(A)));
+      static_assert(std::endian::native == std::endian::little);
+      std::FILE* f = std::fopen(path.string().c_str(), "rb");
+      if (!f)
+        throw std::runtime_error("multi_array: cannot open " + path.string());
+      auto fail = [&](const char* what) {
+        std::fclose(f);
+        throw std::runtime_error(std::string("multi_array: ") + what);
+      };
+
+      std::uint32_t prefix[2];
+      if (std::fread(prefix, sizeof prefix, 1, f) != 1)
+        fail("truncated Arrow message");
+      std::size_t meta = prefix[1];
+      std::vector<unsigned char> buffer;
+      if (prefix[0] != 0xFFFFFFFFu) {
+        // Legacy format without the continuation marker.
+        meta = prefix[0];
+        buffer.resize(meta);
+        std::memcpy(buffer.data(), &prefix[1], std::min<std::size_t>(4, meta));
+        if (meta > 4 && std::fread(buffer.data() + 4, 1, meta - 4, f) != meta - 4)
+          fail("truncated Arrow message");
+      } else {
+        buffer.resize(meta);
+        if (std::fread(buffer.data(), 1, meta, f) != meta)
+          fail("truncated Arrow message");
+      }
+
+      std::uint64_t offset = 0;
+      try {
+        offset = parse_arrow_tensor_impl<A>(buffer.data(), meta);
+      } catch (...) {
+        std::fclose(f);
+        throw;
+      }
+      A result;
+      const std::size_t n = A::total_size();
+      if (std::fseek(f, static_cast<long>(offset), SEEK_CUR) != 0
+          || std::fread(result.data(), sizeof(typename A::element_type), n, f) != n)
+        fail("truncated Arrow tensor body");
+      std::fclose(f);
+      return result;
+    }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_ARROW_H
@@ -0,0 +1,253 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef TB_MULTI_ARRAY_BINARY_H
+#define TB_MULTI_ARRAY_BINARY_H
+
+#include "multi_array.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+#  include <immintrin.h>
+#endif
+
+// Binary file layout (all multi-byte fields in the file's byte order):
+//
+//   char     magic[4]     "TBMA"
+//   char     byte_order   'L' little-endian, 'B' big-endian
+//   char     kind         'i' signed, 'u' unsigned, 'f' floating point
+//   uint8_t  element_size sizeof(T)
+//   uint8_t  order        rank of the array
+//   uint64_t extents[order]
+//   T        data[]       row-major elements
+
+namespace tb {
+
+  // Reverses the bytes of an unsigned integer.
+  template<std::unsigned_integral U>
+    constexpr U byteswap_impl(U x) noexcept
+    {
+      if constexpr (sizeof(U) == 1) {
+        return x;
+      } else {
+        U r = 0;
+        for (std::size_t i = 0; i < sizeof(U); ++i) {
+          r = static_cast<U>((r << 8) | (x & 0xff));
+          x = static_cast<U>(x >> 8);
+        }
+        return r;
+      }
+    }
+
+  template<std::size_t Size>
+    using byteswap_uint_impl =
+      std::conditional_t<Size == 2, std::uint16_t,
+      std::conditional_t<Size == 4, std::uint32_t, std::uint64_t>>;
+
+  // Copies n elements of Size bytes from src to dst, reversing the byte order
+  // of each. The buffers must not overlap.
+  template<std::size_t Size>
+    void copy_byteswap_impl(const unsigned char* src, unsigned char* dst,
+                            std::size_t n) noexcept
+    {
+      static_assert(Size == 2 || Size == 4 || Size == 8);
+      std::size_t i = 0;
+#if defined(__SSSE3__) || defined(__AVX2__)
+      alignas(16) unsigned char mask[16];
+      for (std::size_t b = 0; b < 16; ++b)
+        mask[b] = static_cast<unsigned char>(b - b % Size + (Size - 1 - b % Size));
+      const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+#  if defined(__AVX2__)
+      const __m256i shuffle2 = _mm256_broadcastsi128_si256(shuffle);
+      for (; (i + 32 / Size) <= n; i += 32 / Size) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * Size));
+        v = _mm256_shuffle_epi8(v, shuffle2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * Size), v);
+      }
+#  endif
+      for (; (i + 16 / Size) <= n; i += 16 / Size) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * Size));
+        v = _mm_shuffle_epi8(v, shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * Size), v);
+      }
+#endif
+      using U = byteswap_uint_impl<Size>;
+      for (; i < n; ++i) {
+        U x;
+        std::memcpy(&x, src + i * Size, Size);
+        x = byteswap_impl(x);
+        std::memcpy(dst + i * Size, &x, Size);
+      }
+    }
+
+  // Copies n elements of type T, swapping byte order when swap is set.
+  template<typename T>
+    void copy_bytes_impl(const void* src, void* dst, std::size_t n, bool swap)
+    {
+      if constexpr (sizeof(T) > 1) {
+        if (swap) {
+          copy_byteswap_impl<sizeof(T)>(static_cast<const unsigned char*>(src),
+                                        static_cast<unsigned char*>(dst), n);
+          return;
+        }
+      }
+      std::memcpy(dst, src, n * sizeof(T));
+    }
+
+  template<typename T>
+    constexpr char binary_kind_impl() noexcept
+    {
+      if constexpr (std::is_floating_point_v<T>) return 'f';
+      else if constexpr (std::is_signed_v<T>) return 'i';
+      else return 'u';
+    }
+
+  // Element types that can be stored in and byte-swapped from binary files.
+  template<typename T>
+    concept Binary_element = std::is_arithmetic_v<T>
+      && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+
+  struct binary_file_impl {
+    std::FILE* f;
+    ~binary_file_impl() { if (f) std::fclose(f); }
+  };
+
+  // Size of the staging buffer used when converting byte order.
+  inline constexpr std::size_t binary_buffer_size = std::size_t{1} << 20;
+
+  // Writes a to a binary file in the given byte order.
+  template<Multi_array A>
+      requires Binary_element<typename A::element_type>
+    void save_binary(const std::filesystem::path& path, const A& a,
+                     std::endian order = std::endian::native)
+    {
+      TB_MULTI_ARRAY_TIMED(save_binary);
+      TB_MULTI_ARRAY_SPAN("io", "save_binary", static_cast<std::int64_t>(sizeof(A)));
+      using T = typename A::element_type;
+      constexpr std::size_t n = A::total_size();
+      const bool swap = order != std::endian::native;
+
+      binary_file_impl file{std::fopen(path.string().c_str(), "wb")};
+      if (!file.f)
+        throw std::runtime_error("multi_array: cannot open " + path.string());
+
+      unsigned char header[8] = {
+        'T', 'B', 'M', 'A',
+        static_cast<unsigned char>(order == std::endian::big ? 'B' : 'L'),
+        static_cast<unsigned char>(binary_kind_impl<T>()),
+        static_cast<unsigned char>(sizeof(T)),
+        static_cast<unsigned char>(A::order())
+      };
+      bool ok = std::fwrite(header, 1, sizeof header, file.f) == sizeof header;
+
+      std::uint64_t dims[A::order()];
+      for (std::size_t i = 0; i < A::order(); ++i) {
+        dims[i] = extents(a)[i];
+        if (swap) dims[i] = byteswap_impl(dims[i]);
+      }
+      ok = ok && std::fwrite(dims, sizeof dims, 1, file.f) == 1;
+
+      if (!swap) {
+        ok = ok && std::fwrite(a.data(), sizeof(T), n, file.f) == n;
+      } else {
+        constexpr std::size_t chunk = binary_buffer_size / sizeof(T);
+        auto buffer = std::make_unique<unsigned char[]>(chunk * sizeof(T));
+        for (std::size_t i = 0; ok && i < n; i += chunk) {
+          const std::size_t m = std::min(chunk, n - i);
+          copy_bytes_impl<T>(a.data() + i, buffer.get(), m, true);
+          ok = std::fwrite(buffer.get(), sizeof(T), m, file.f) == m;
+        }
+      }
+      if (!ok || std::fclose(std::exchange(file.f, nullptr)) != 0)
+        throw std::runtime_error("multi_array: cannot write " + path.string());
+    }
+
+  // Reads a binary file written by save_binary(), converting from the byte
+  // order recorded in the file. The element kind, size and extents must
+  // match A exactly. Throws std::runtime_error on any mismatch or I/O error.
+  template<Multi_array A>
+      requires Binary_element<typename A::element_type>
+    A load_binary(const std::filesystem::path& path)
+    {
+      TB_MULTI_ARRAY_TIMED(load_binary);
+      TB_MULTI_ARRAY_SPAN("io", "load_binary", static_cast<std::int64_t>(sizeof(A)));
+      using T = typename A::element_type;
+      constexpr std::size_t n = A::total_size();
+
+      binary_file_impl file{std::fopen(path.string().c_str(), "rb")};
+      if (!file.f)
+        throw std::runtime_error("multi_array: cannot open " + path.string());
+
+      unsigned char header[8];
+      if (std::fread(header, 1, sizeof header, file.f) != sizeof header
+          || std::memcmp(header, "TBMA", 4) != 0)
+        throw std::runtime_error("multi_array: not a multi_array file");
+      if (header[4] != 'L' && header[4] != 'B')
+        throw std::runtime_error("multi_array: unknown byte order");
+      const auto order = header[4] == 'B' ? std::endian::big
+                                          : std::endian::little;
+      const bool swap = order != std::endian::native;
+      if (header[5] != binary_kind_impl<T>() || header[6] != sizeof(T))
+        throw std::runtime_error("multi_array: element type mismatch");
+      if (header[7] != A::order())
+        throw std::runtime_error("multi_array: rank mismatch");
+
+      A result;
+      std::uint64_t dims[A::order()];
+      if (std::fread(dims, sizeof dims, 1, file.f) != 1)
+        throw std::runtime_error("multi_array: truncated file");
+      for (std::size_t i = 0; i < A::order(); ++i) {
+        if (swap) dims[i] = byteswap_impl(dims[i]);
+        if (dims[i] != extents(result)[i])
+          throw std::runtime_error("multi_array: extent mismatch");
+      }
+
+      bool ok = true;
+      if (!swap) {
+        ok = std::fread(result.data(), sizeof(T), n, file.f) == n;
+      } else {
+        // Convert while copying out of the staging buffer, so the data is
+        // touched once after it has been read.
+        constexpr std::size_t chunk = binary_buffer_size / sizeof(T);
+        auto buffer = std::make_unique<unsigned char[]>(chunk * sizeof(T));
+        for (std::size_t i = 0; ok && i < n; i += chunk) {
+          const std::size_t m = std::min(chunk, n - i);
+          ok = std::fread(buffer.get(), sizeof(T), m, file.f) == m;
+          copy_bytes_impl<T>(buffer.get(), result.data() + i, m, true);
+        }
+      }
+      if (!ok)
+        throw std::runtime_error("multi_array: truncated file");
+      return result;
+    }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_BINARY_H
@@ -0,0 +1,65 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Cache geometry, and eviction of data from the cache so that kernels can
+// be timed against memory rather than a warm cache. The cache size and the
+// streaming kernels are in multi_array_nontemporal.h.
+
+#ifndef TB_MULTI_ARRAY_CACHE_H
+#define TB_MULTI_ARRAY_CACHE_H
+
+#include "multi_array_nontemporal.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+namespace tb {
+
+  inline constexpr std::size_t cache_line = 64;
+
+  // Evicts the n bytes at p from every cache level: line by line where the
+  // instruction set allows it, otherwise by writing a buffer of twice the
+  // size of the largest cache.
+  inline void cache_flush_impl(const void* p, std::size_t n)
+  {
+#if defined(__SSE2__)
+    const auto first = reinterpret_cast<std::uintptr_t>(p) / cache_line * cache_line;
+    for (auto line = first; line < reinterpret_cast<std::uintptr_t>(p) + n; line += cache_line)
+      _mm_clflush(reinterpret_cast<const void*>(line));
+    _mm_mfence();
+#else
+    (void)p, (void)n;
+    const std::size_t bytes = 2 * llc_size();
+    const std::unique_ptr<char[]> buffer(new char[bytes]);
+    volatile char* v = buffer.get();
+    for (std::size_t i = 0; i < bytes; i += cache_line) v[i] = 0;
+#endif
+  }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_CACHE_H
@@ -0,0 +1,217 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Copy accounting, enabled by defining TB_MULTI_ARRAY_COPY_ACCOUNTING before
+// including multi_array.h. Copy constructions (including moves, which copy
+// the inline storage), copy assignments and swaps are counted per
+// multi_array type together with the bytes they copied. Copies at or above
+// copy_accounting_threshold() bytes are also passed to a handler, which by
+// default prints the type and a stack trace to stderr.
+
+#ifndef TB_MULTI_ARRAY_COPY_H
+#define TB_MULTI_ARRAY_COPY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#if __has_include(<execinfo.h>)
+#  include <execinfo.h>
+#  define TB_MULTI_ARRAY_HAS_BACKTRACE
+#endif
+
+namespace tb {
+
+  enum class copy_kind { construct, assign, swap };
+
+  // Copies recorded for one multi_array type.
+  struct copy_stats {
+    const std::type_info* type = nullptr;
+    std::uint64_t constructions = 0;
+    std::uint64_t assignments = 0;
+    std::uint64_t swaps = 0;
+    std::uint64_t bytes = 0;  // a swap counts both arrays
+  };
+
+  // A single copy at or above the threshold.
+  struct copy_event {
+    const std::type_info& type;
+    copy_kind kind;
+    std::size_t bytes;
+  };
+
+  using copy_handler = void (*)(const copy_event&);
+
+  inline const char* copy_kind_name(copy_kind kind) noexcept
+  {
+    switch (kind) {
+      case copy_kind::construct: return "copy construction";
+      case copy_kind::assign: return "copy assignment";
+      case copy_kind::swap: return "swap";
+    }
+    return "?";
+  }
+
+  // Prints the event and, where <execinfo.h> is available, the stack.
+  inline void print_copy_event(const copy_event& e)
+  {
+    std::fprintf(stderr, "multi_array: %s of %zu bytes (%s)\n",
+                 copy_kind_name(e.kind), e.bytes, e.type.name());
+#ifdef TB_MULTI_ARRAY_HAS_BACKTRACE
+    void* frames[64];
+    const int n = ::backtrace(frames, 64);
+    std::fflush(stderr);
+    ::backtrace_symbols_fd(frames, n, 2);
+#endif
+  }
+
+  struct copy_registry_impl {
+    std::mutex mutex;
+    std::map<std::type_index, copy_stats> types;
+    std::atomic<std::size_t> threshold{0};  // 0 disables the handler
+    std::atomic<copy_handler> handler{print_copy_event};
+
+    static copy_registry_impl& get()
+    {
+      static copy_registry_impl instance;
+      return instance;
+    }
+  };
+
+  // Copies of at least bytes bytes are passed to the handler; 0 disables it.
+  inline void copy_accounting_threshold(std::size_t bytes) noexcept
+  { copy_registry_impl::get().threshold = bytes; }
+
+  inline std::size_t copy_accounting_threshold() noexcept
+  { return copy_registry_impl::get().threshold; }
+
+  // Replaces the handler and returns the previous one.
+  inline copy_handler set_copy_handler(copy_handler h) noexcept
+  { return copy_registry_impl::get().handler.exchange(h ? h : print_copy_event); }
+
+  inline void
+  copy_record(const std::type_info& type, copy_kind kind, std::size_t bytes)
+  {
+    auto& registry = copy_registry_impl::get();
+    {
+      std::lock_guard lock(registry.mutex);
+      copy_stats& s = registry.types[type];
+      s.type = &type;
+      switch (kind) {
+        case copy_kind::construct: ++s.constructions; break;
+        case copy_kind::assign: ++s.assignments; break;
+        case copy_kind::swap: ++s.swaps; break;
+      }
+      s.bytes += bytes;
+    }
+    const std::size_t threshold = registry.threshold;
+    if (threshold != 0 && bytes >= threshold)
+      registry.handler.load()(copy_event{ type, kind, bytes });
+  }
+
+  // Nesting depth of copy scopes on this thread. A rank-N copy is made of
+  // sub-array copies; only the outermost one is recorded.
+  inline int& copy_depth_impl() noexcept
+  {
+    thread_local int depth = 0;
+    return depth;
+  }
+
+  // Records a copy of A when it is the outermost scope on this thread. The
+  // default constructor only suppresses recording of nested copies.
+  template<typename A>
+    class copy_scope {
+    public:
+      constexpr copy_scope() noexcept
+      { if (!std::is_constant_evaluated()) ++copy_depth_impl(); }
+
+      // Accounting never makes a copy or swap throw.
+      constexpr explicit copy_scope(copy_kind kind) noexcept
+      {
+        if (std::is_constant_evaluated()) return;
+        if (copy_depth_impl()++ == 0) {
+          try {
+            copy_record(typeid(A), kind,
+                        kind == copy_kind::swap ? 2 * sizeof(A) : sizeof(A));
+          } catch (...) {}
+        }
+      }
+
+      copy_scope(const copy_scope&) = delete;
+      copy_scope& operator=(const copy_scope&) = delete;
+
+      constexpr ~copy_scope()
+      { if (!std::is_constant_evaluated()) --copy_depth_impl(); }
+    };
+
+  // Copies recorded for A so far.
+  template<typename A>
+    copy_stats copy_stats_for()
+    {
+      auto& registry = copy_registry_impl::get();
+      std::lock_guard lock(registry.mutex);
+      auto it = registry.types.find(typeid(A));
+      return it == registry.types.end() ? copy_stats{ &typeid(A) } : it->second;
+    }
+
+  inline std::vector<copy_stats> copy_snapshot()
+  {
+    auto& registry = copy_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    std::vector<copy_stats> result;
+    for (const auto& entry : registry.types) result.push_back(entry.second);
+    return result;
+  }
+
+  inline void copy_reset()
+  {
+    auto& registry = copy_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    registry.types.clear();
+  }
+
+  // Prints one line per type, most bytes copied first.
+  inline void copy_report(std::FILE* out = stderr)
+  {
+    auto types = copy_snapshot();
+    std::sort(types.begin(), types.end(), [](const auto& a, const auto& b) {
+      return a.bytes > b.bytes;
+    });
+    for (const auto& s : types)
+      std::fprintf(out, "%s: constructions %llu, assignments %llu, swaps %llu, "
+                   "bytes %llu\n", s.type->name(),
+                   (unsigned long long)s.constructions,
+                   (unsigned long long)s.assignments,
+                   (unsigned long long)s.swaps, (unsigned long long)s.bytes);
+  }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_COPY_H
@@ -0,0 +1,215 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef TB_MULTI_ARRAY_DLPACK_H
+#define TB_MULTI_ARRAY_DLPACK_H
+
+#include "multi_array.h"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+// Minimal, ABI-compatible subset of dlpack.h (v0.8). Skipped if the real
+// header has already been included.
+#ifndef DLPACK_DLPACK_H_
+extern "C" {
+  typedef enum {
+    kDLCPU = 1,
+  } DLDeviceType;
+
+  typedef struct {
+    DLDeviceType device_type;
+    int32_t device_id;
+  } DLDevice;
+
+  typedef enum {
+    kDLInt = 0U,
+    kDLUInt = 1U,
+    kDLFloat = 2U,
+    kDLBool = 6U,
+  } DLDataTypeCode;
+
+  typedef struct {
+    uint8_t code;
+    uint8_t bits;
+    uint16_t lanes;
+  } DLDataType;
+
+  typedef struct {
+    void* data;
+    DLDevice device;
+    int32_t ndim;
+    DLDataType dtype;
+    int64_t* shape;
+    int64_t* strides;
+    uint64_t byte_offset;
+  } DLTensor;
+
+  typedef struct DLManagedTensor {
+    DLTensor dl_tensor;
+    void* manager_ctx;
+    void (*deleter)(struct DLManagedTensor* self);
+  } DLManagedTensor;
+}
+#endif
+
+namespace tb {
+
+  // DLPack data type describing T.
+  template<typename T>
+      requires std::is_arithmetic_v<T>
+    constexpr DLDataType dlpack_dtype() noexcept
+    {
+      uint8_t code = std::is_same_v<T, bool> ? kDLBool
+                   : std::is_floating_point_v<T> ? kDLFloat
+                   : std::is_signed_v<T> ? kDLInt : kDLUInt;
+      return DLDataType{ code, static_cast<uint8_t>(sizeof(T) * 8), 1 };
+    }
+
+  // Storage for an exported tensor: the DLManagedTensor plus its shape and
+  // strides, and optionally the array it owns.
+  template<Multi_array A>
+    struct dlpack_export_impl {
+      DLManagedTensor managed;
+      int64_t shape[A::order()];
+      int64_t strides[A::order()];
+      std::unique_ptr<A> owned;
+
+      static void deleter(DLManagedTensor* self)
+      { delete static_cast<dlpack_export_impl*>(self->manager_ctx); }
+    };
+
+  template<Multi_array A>
+    DLManagedTensor* to_dlpack_impl(A& a, std::unique_ptr<A> owned)
+    {
+      auto* p = new dlpack_export_impl<A>;
+      const auto dims = extents(a);
+      int64_t stride = 1;
+      for (std::size_t i = A::order(); i-- > 0; ) {
+        p->shape[i] = static_cast<int64_t>(dims[i]);
+        p->strides[i] = stride;
+        stride *= p->shape[i];
+      }
+      p->owned = std::move(owned);
+      p->managed.dl_tensor = DLTensor{
+        const_cast<void*>(static_cast<const void*>(a.data())),
+        DLDevice{ kDLCPU, 0 },
+        static_cast<int32_t>(A::order()),
+        dlpack_dtype<typename A::element_type>(),
+        p->shape, p->strides, 0
+      };
+      p->managed.manager_ctx = p;
+      p->managed.deleter = &dlpack_export_impl<A>::deleter;
+      return &p->managed;
+    }
+
+  // Exports a without copying. The array must outlive the consumer's use of
+  // the tensor; calling the deleter only releases the tensor metadata.
+  template<Multi_array A>
+    DLManagedTensor* to_dlpack(A& a)
+    { return to_dlpack_impl<A>(a, nullptr); }
+
+  // Exports an array and hands its ownership to the consumer, which frees it
+  // through the tensor's deleter.
+  template<Multi_array A>
+    DLManagedTensor* to_dlpack(std::unique_ptr<A> a)
+    {
+      A& ref = *a;
+      return to_dlpack_impl(ref, std::move(a));
+    }
+
+  // Owns an imported DLManagedTensor and views its data as a multi_array.
+  // The producer's deleter is called on destruction.
+  template<Multi_array A>
+    class dlpack_handle {
+    public:
+      explicit dlpack_handle(DLManagedTensor* t) noexcept : tensor_(t) {}
+
+      dlpack_handle(dlpack_handle&& h) noexcept
+        : tensor_(std::exchange(h.tensor_, nullptr)) {}
+
+      dlpack_handle& operator=(dlpack_handle h) noexcept
+      { std::swap(tensor_, h.tensor_); return *this; }
+
+      ~dlpack_handle()
+      { if (tensor_ && tensor_->deleter) tensor_->deleter(tensor_); }
+
+      A& operator*() const noexcept
+      { return *static_cast<A*>(address()); }
+
+      A* operator->() const noexcept
+      { return static_cast<A*>(address()); }
+
+      DLManagedTensor* get() const noexcept { return tensor_; }
+
+    private:
+      void* address() const noexcept
+      {
+        return static_cast<char*>(tensor_->dl_tensor.data)
+               + tensor_->dl_tensor.byte_offset;
+      }
+
+      DLManagedTensor* tensor_;
+    };
+
+  // Imports a tensor without copying. The tensor must be on the CPU, have
+  // the element type, rank and extents of A, and be compact and row-major.
+  // Ownership is taken immediately, so the tensor is released even when
+  // validation throws std::runtime_error.
+  template<Multi_array A>
+    dlpack_handle<A> from_dlpack(DLManagedTensor* t)
+    {
+      using T = typename A::element_type;
+      dlpack_handle<A> handle(t);
+      if (!t)
+        throw std::runtime_error("multi_array: null DLPack tensor");
+      const DLTensor& dl = t->dl_tensor;
+      const DLDataType want = dlpack_dtype<T>();
+      if (dl.device.device_type != kDLCPU)
+        throw std::runtime_error("multi_array: DLPack tensor not on CPU");
+      if (dl.dtype.code != want.code || dl.dtype.bits != want.bits
+          || dl.dtype.lanes != want.lanes)
+        throw std::runtime_error("multi_array: DLPack dtype mismatch");
+      if (dl.ndim != static_cast<int32_t>(A::order()))
+        throw std::runtime_error("multi_array: DLPack rank mismatch");
+
+      constexpr auto dims = multi_array_extents_v<A>;
+      int64_t stride = 1;
+      for (std::size_t i = A::order(); i-- > 0; ) {
+        if (dl.shape[i] != static_cast<int64_t>(dims[i]))
+          throw std::runtime_error("multi_array: DLPack shape mismatch");
+        if (dl.strides && dims[i] > 1 && dl.strides[i] != stride)
+          throw std::runtime_error("multi_array: DLPack tensor not row-major");
+        stride *= dl.shape[i];
+      }
+      const auto address = reinterpret_cast<std::uintptr_t>(dl.data)
+                           + dl.byte_offset;
+      if (address % alignof(A) != 0)
+        throw std::runtime_error("multi_array: misaligned DLPack data");
+      return handle;
+    }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_DLPACK_H
@@ -0,0 +1,254 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Profile-guided layout advice. After a representative run with
+// TB_MULTI_ARRAY_TRACE defined, recommend_layouts() replays each traced
+// array's element accesses through a set-associative LRU cache model under
+// alternative layouts (row-major, row-major with padded rows, column-major,
+// square tiles and Morton order) and reports the estimated misses of each,
+// plus the alignment the array should have.
+
+#ifndef TB_MULTI_ARRAY_LAYOUT_H
+#define TB_MULTI_ARRAY_LAYOUT_H
+
+#include "multi_array_trace.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace tb {
+
+  struct cache_config {
+    std::size_t size = 32 * 1024;
+    std::size_t ways = 8;
+    std::size_t line = 64;
+  };
+
+  // Set-associative cache with LRU replacement.
+  class cache_model {
+  public:
+    explicit cache_model(const cache_config& c)
+      : line_(c.line), ways_(c.ways),
+        sets_(std::max<std::size_t>(1, c.size / (c.line * c.ways))),
+        tags_(sets_ * ways_, UINT64_MAX), stamps_(sets_ * ways_, 0) {}
+
+    // Touches the byte at address; returns true on a miss.
+    bool access(std::uint64_t address) noexcept
+    {
+      const std::uint64_t line = address / line_;
+      const std::size_t set = line % sets_;
+      std::uint64_t* tags = &tags_[set * ways_];
+      std::uint64_t* stamps = &stamps_[set * ways_];
+      ++clock_;
+      std::size_t victim = 0;
+      for (std::size_t w = 0; w < ways_; ++w) {
+        if (tags[w] == line) { stamps[w] = clock_; return false; }
+        if (stamps[w] < stamps[victim]) victim = w;
+      }
+      tags[victim] = line;
+      stamps[victim] = clock_;
+      return true;
+    }
+
+  private:
+    std::size_t line_, ways_, sets_;
+    std::vector<std::uint64_t> tags_, stamps_;
+    std::uint64_t clock_ = 0;
+  };
+
+  enum class layout_kind { row_major, padded_row_major, column_major, tiled, morton };
+
+  struct layout_estimate {
+    layout_kind kind;
+    std::size_t parameter = 0;  // padding or tile edge in elements
+    std::uint64_t misses = 0;
+
+    std::string name() const
+    {
+      switch (kind) {
+        case layout_kind::row_major: return "row-major";
+        case layout_kind::padded_row_major:
+          return "row-major, rows padded by " + std::to_string(parameter);
+        case layout_kind::column_major: return "column-major";
+        case layout_kind::tiled:
+          return "tiled " + std::to_string(parameter) + "x" + std::to_string(parameter);
+        case layout_kind::morton: return "Morton";
+      }
+      return "?";
+    }
+  };
+
+  struct layout_advice {
+    const void* array = nullptr;
+    const std::type_info* type = nullptr;
+    std::vector<std::size_t> extents;
+    std::uint64_t accesses = 0;                // replayed accesses
+    std::vector<layout_estimate> estimates;    // current layout first
+    layout_estimate best{};
+    std::size_t alignment = 0;                 // recommended, in bytes
+    bool aligned = false;                      // whether it already is
+
+    std::uint64_t saved_misses() const noexcept
+    { return estimates.empty() ? 0 : estimates.front().misses - best.misses; }
+  };
+
+  // Byte offset of element offset (row-major over extents) under a layout.
+  // Extents are padded to multiples of the tile edge or powers of two.
+  inline std::uint64_t
+  layout_address_impl(const std::vector<std::size_t>& extents, std::uint64_t offset,
+                      const layout_estimate& layout)
+  {
+    const std::size_t rank = extents.size();
+    std::size_t index[8] = {};
+    for (std::size_t d = rank; d-- > 0; ) {
+      index[d] = offset % extents[d];
+      offset /= extents[d];
+    }
+    std::uint64_t address = 0;
+    switch (layout.kind) {
+      case layout_kind::row_major:
+      case layout_kind::padded_row_major:
+        for (std::size_t d = 0; d < rank; ++d) {
+          const std::size_t extent = d + 1 == rank
+            && layout.kind == layout_kind::padded_row_major
+            ? extents[d] + layout.parameter : extents[d];
+          address = address * extent + index[d];
+        }
+        return address;
+      case layout_kind::column_major:
+        for (std::size_t d = rank; d-- > 0; ) address = address * extents[d] + index[d];
+        return address;
+      case layout_kind::tiled: {
+        const std::size_t t = layout.parameter;
+        for (std::size_t d = 0; d + 2 < rank; ++d) address = address * extents[d] + index[d];
+        const std::size_t rows = (extents[rank - 2] + t - 1) / t;
+        const std::size_t cols = (extents[rank - 1] + t - 1) / t;
+        address = (address * rows + index[rank - 2] / t) * cols + index[rank - 1] / t;
+        return (address * t + index[rank - 2] % t) * t + index[rank - 1] % t;
+      }
+      case layout_kind::morton:
+        for (int bit = 31; bit >= 0; --bit)
+          for (std::size_t d = 0; d < rank; ++d)
+            address = (address << 1) | ((index[d] >> bit) & 1);
+        return address;
+    }
+    return address;
+  }
+
+  inline std::uint64_t
+  simulate_layout_impl(const trace_log& log, const layout_estimate& layout,
+                       std::uint64_t base, const cache_config& config)
+  {
+    cache_model cache(config);
+    std::uint64_t misses = 0;
+    for (std::uint64_t offset : log.offsets)
+      misses += cache.access(base + layout_address_impl(log.extents, offset, layout)
+                                    * log.element_size);
+    return misses;
+  }
+
+  // Layout advice for every traced array with element accesses, most
+  // misses saved first.
+  inline std::vector<layout_advice>
+  recommend_layouts(const cache_config& config = {})
+  {
+    std::vector<layout_advice> result;
+    for (const auto& [array, log] : trace_logs()) {
+      const std::size_t rank = log.extents.size();
+      if (log.offsets.empty() || rank > 8) continue;
+      layout_advice a;
+      a.array = array;
+      a.type = log.type;
+      a.extents = log.extents;
+      a.accesses = log.offsets.size();
+
+      std::size_t bytes = log.element_size;
+      for (std::size_t e : log.extents) bytes *= e;
+      a.alignment = bytes >= (std::size_t{2} << 20) ? std::size_t{2} << 20
+                  : bytes >= 4096 ? 4096 : config.line;
+      const auto address = reinterpret_cast<std::uintptr_t>(array);
+      a.aligned = address % a.alignment == 0;
+
+      // The current layout keeps the array's actual offset within a line.
+      const std::uint64_t base = address % config.line;
+      layout_estimate current{ layout_kind::row_major };
+      current.misses = simulate_layout_impl(log, current, base, config);
+      a.estimates.push_back(current);
+
+      auto consider = [&](layout_estimate e) {
+        e.misses = simulate_layout_impl(log, e, 0, config);
+        a.estimates.push_back(e);
+      };
+      consider({ layout_kind::row_major });
+      if (rank >= 2) {
+        const std::size_t row_bytes = log.extents.back() * log.element_size;
+        if (std::has_single_bit(row_bytes) && row_bytes >= config.line)
+          consider({ layout_kind::padded_row_major,
+                     std::max<std::size_t>(1, config.line / log.element_size) });
+        consider({ layout_kind::column_major });
+        for (std::size_t t : { 4, 8, 16, 32 })
+          if (t < log.extents[rank - 1] || t < log.extents[rank - 2])
+            consider({ layout_kind::tiled, t });
+        if (rank <= 3) consider({ layout_kind::morton });
+      }
+      a.best = *std::min_element(a.estimates.begin(), a.estimates.end(),
+                                 [](const auto& x, const auto& y) {
+                                   return x.misses < y.misses;
+                                 });
+      result.push_back(std::move(a));
+    }
+    std::sort(result.begin(), result.end(), [](const auto& x, const auto& y) {
+      return x.saved_misses() > y.saved_misses();
+    });
+    return result;
+  }
+
+  // Prints recommend_layouts() in readable form.
+  inline void layout_report(std::FILE* out = stderr, const cache_config& config = {})
+  {
+    for (const auto& a : recommend_layouts(config)) {
+      std::fprintf(out, "%p %s [", a.array, a.type ? a.type->name() : "?");
+      for (std::size_t d = 0; d < a.extents.size(); ++d)
+        std::fprintf(out, "%s%zu", d ? " x " : "", a.extents[d]);
+      std::fprintf(out, "], %llu accesses\n", (unsigned long long)a.accesses);
+      for (std::size_t i = 0; i < a.estimates.size(); ++i)
+        std::fprintf(out, "  %-36s %12llu misses%s\n",
+                     (a.estimates[i].name() + (i == 0 ? " (current)" : "")).c_str(),
+                     (unsigned long long)a.estimates[i].misses,
+                     i > 0 && a.estimates[i].kind == a.best.kind
+                       && a.estimates[i].parameter == a.best.parameter
+                       && a.estimates[i].misses == a.best.misses ? "  <- best" : "");
+      std::fprintf(out, "  recommend %s, aligned to %zu bytes (%s); "
+                   "estimated %llu fewer misses\n", a.best.name().c_str(),
+                   a.alignment, a.aligned ? "already" : "currently not",
+                   (unsigned long long)a.saved_misses());
+    }
+  }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_LAYOUT_H
@@ -0,0 +1,569 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Dense linear algebra on multi_arrays: dot products, axpy, norms and
+// matrix-vector products, and LU and Cholesky factorizations of square
+// rank-2 arrays, in place. Matrices of at most linalg_unroll_limit rows are
+// factored by fully unrolled straight-line code; larger ones by blocked
+// right-looking algorithms whose trailing updates are contiguous row
+// updates that the compiler vectorizes, split between threads for large
+// matrices.
+
+#ifndef TB_MULTI_ARRAY_LINALG_H
+#define TB_MULTI_ARRAY_LINALG_H
+
+#include "multi_array.h"
+#include "multi_array_parallel.h"
+#include "multi_array_tune.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace tb {
+
+  // Matrices of at most this many rows are factored by unrolled code.
+  inline constexpr std::size_t linalg_unroll_limit = 8;
+  // Defaults of the tuned parameters below (see multi_array_tune.h).
+  // Columns factored per step of the blocked algorithms.
+  inline constexpr std::size_t linalg_block = 64;
+  // Matrices of at least this many rows have their updates threaded.
+  inline constexpr std::size_t linalg_parallel_min = 256;
+  // Matrix-vector products over at least this many bytes are threaded.
+  inline constexpr std::size_t linalg_parallel_bytes = std::size_t{4} << 20;
+
+  inline std::size_t linalg_block_size()
+  {
+    static const long block = tuned_value("linalg.block", linalg_block);
+    return static_cast<std::size_t>(std::max(1l, block));
+  }
+
+  inline std::size_t linalg_parallel_rows()
+  {
+    static const long rows = tuned_value("linalg.parallel_min", linalg_parallel_min);
+    return static_cast<std::size_t>(std::max(1l, rows));
+  }
+
+  inline std::size_t linalg_parallel_size()
+  {
+    static const long bytes = tuned_value("linalg.parallel_bytes", linalg_parallel_bytes);
+    return static_cast<std::size_t>(std::max(1l, bytes));
+  }
+
+  // Value of an index passed by unroll_impl().
+  template<typename I>
+    inline constexpr std::size_t unrolled_v = std::remove_cvref_t<I>::value;
+
+  // y[0, n) -= a * x[0, n). Written out eight elements at a time, which
+  // the compiler turns into SIMD operations even where it would not
+  // vectorize the loop itself (GCC at -O2).
+  template<typename T>
+    inline void
+    linalg_axpy_impl(T* __restrict y, const T* __restrict x, T a, std::size_t n) noexcept
+    {
+      const std::size_t m = n - n % 8;
+      for (std::size_t j = 0; j < m; j += 8) {
+        y[j]     -= a * x[j];
+        y[j + 1] -= a * x[j + 1];
+        y[j + 2] -= a * x[j + 2];
+        y[j + 3] -= a * x[j + 3];
+        y[j + 4] -= a * x[j + 4];
+        y[j + 5] -= a * x[j + 5];
+        y[j + 6] -= a * x[j + 6];
+        y[j + 7] -= a * x[j + 7];
+      }
+      for (std::size_t j = m; j < n; ++j) y[j] -= a * x[j];
+    }
+
+  // Sum of x[j] * y[j] over [0, n), with eight independent accumulators so
+  // that the additions neither wait on each other nor block vectorization.
+  template<typename T>
+    inline T linalg_dot_impl(const T* x, const T* y, std::size_t n) noexcept
+    {
+      T acc[8] = {};
+      const std::size_t m = n - n % 8;
+      for (std::size_t j = 0; j < m; j += 8) {
+        acc[0] += x[j]     * y[j];
+        acc[1] += x[j + 1] * y[j + 1];
+        acc[2] += x[j + 2] * y[j + 2];
+        acc[3] += x[j + 3] * y[j + 3];
+        acc[4] += x[j + 4] * y[j + 4];
+        acc[5] += x[j + 5] * y[j + 5];
+        acc[6] += x[j + 6] * y[j + 6];
+        acc[7] += x[j + 7] * y[j + 7];
+      }
+      // The remainder gets its own accumulator and loop bounds; continuing
+      // the loop above with acc[j % 8] makes GCC warn of out-of-bounds
+      // iterations when n is a multiple of 8.
+      T rest = T();
+      for (std::size_t j = m; j < n; ++j) rest += x[j] * y[j];
+      return ((acc[0] + acc[4]) + (acc[1] + acc[5])) + ((acc[2] + acc[6]) + (acc[3] + acc[7]))
+             + rest;
+    }
+
+  // Sum of f(x[j]) over [0, n), accumulated as in linalg_dot_impl(), or
+  // the largest f(x[j]) if max.
+  template<bool max, typename T, typename F>
+    inline T linalg_reduce_impl(const T* x, std::size_t n, F f) noexcept
+    {
+      auto combine = [](T a, T b) {
+        if constexpr (max) return a < b ? b : a;
+        else return a + b;
+      };
+      T acc[8] = {};
+      const std::size_t m = n - n % 8;
+      for (std::size_t j = 0; j < m; j += 8)
+        for (std::size_t k = 0; k < 8; ++k) acc[k] = combine(acc[k], f(x[j + k]));
+      T rest = T();
+      for (std::size_t j = m; j < n; ++j) rest = combine(rest, f(x[j]));
+      return combine(combine(combine(combine(acc[0], acc[4]), combine(acc[1], acc[5])),
+                             combine(combine(acc[2], acc[6]), combine(acc[3], acc[7]))),
+                     rest);
+    }
+
+  // Sum of the products of corresponding elements of x and y.
+  template<Multi_array A>
+    typename A::element_type dot(const A& x, const A& y) noexcept
+    {
+      TB_MULTI_ARRAY_TIMED(dot);
+      return linalg_dot_impl(x.data(), y.data(), A::total_size());
+    }
+
+  // y += a x
+  template<Multi_array A>
+    void axpy(typename A::element_type a, const A& x, A& y) noexcept
+    {
+      TB_MULTI_ARRAY_TIMED(axpy);
+      if (&x == &y) {
+        for (auto* p = y.data(); p != y.data() + A::total_size(); ++p) *p += a * *p;
+        return;
+      }
+      linalg_axpy_impl(y.data(), x.data(), -a, A::total_size());
+    }
+
+  // Euclidean norm of the elements of x (the Frobenius norm of a matrix).
+  template<Multi_array A>
+    typename A::element_type norm2(const A& x) noexcept
+    {
+      TB_MULTI_ARRAY_TIMED(norm);
+      using std::sqrt;
+      return sqrt(linalg_dot_impl(x.data(), x.data(), A::total_size()));
+    }
+
+  // Sum of the absolute values of the elements of x.
+  template<Multi_array A>
+    typename A::element_type norm1(const A& x) noexcept
+    {
+      TB_MULTI_ARRAY_TIMED(norm);
+      using T = typename A::element_type;
+      return linalg_reduce_impl<false>(x.data(), A::total_size(), [](T v) {
+        using std::abs;
+        return abs(v);
+      });
+    }
+
+  // Largest absolute value of the elements of x.
+  template<Multi_array A>
+    typename A::element_type norm_inf(const A& x) noexcept
+    {
+      TB_MULTI_ARRAY_TIMED(norm);
+      using T = typename A::element_type;
+      return linalg_reduce_impl<true>(x.data(), A::total_size(), [](T v) {
+        using std::abs;
+        return abs(v);
+      });
+    }
+
+  // y = a x on parts bands of rows, one per thread.
+  template<typename T, std::size_t M, std::size_t N>
+    void matvec_impl(const multi_array<T, M, N>& a, const multi_array<T, N>& x,
+                     multi_array<T, M>& y, std::size_t parts)
+    {
+      const T* v = x.data();
+      auto rows = [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i)
+          y[i] = linalg_dot_impl(a[i].data(), v, N);
+      };
+      if (parts <= 1) return rows(0, M);
+      parallel_for_impl(parts, [&](std::size_t t) {
+        rows(M * t / parts, M * (t + 1) / parts);
+      }, "matvec");
+    }
+
+  // y = a x. Each row of a is read once, as a dot product with x; products
+  // of at least linalg_parallel_size() bytes are split into bands of rows,
+  // one per thread (threads bounds them; 0: one per hardware thread).
+  template<typename T, std::size_t M, std::size_t N>
+    void matvec(const multi_array<T, M, N>& a, const multi_array<T, N>& x,
+                multi_array<T, M>& y, std::size_t threads = 0)
+    {
+      TB_MULTI_ARRAY_SPAN("linalg", "matvec", static_cast<std::int64_t>(M));
+      TB_MULTI_ARRAY_TIMED(matvec);
+      constexpr std::size_t bytes = M * N * sizeof(T);
+      const std::size_t chunk = linalg_parallel_size();
+      matvec_impl(a, x, y, bytes < chunk
+                  ? 1 : std::min({ thread_count_impl(threads), M, bytes / chunk }));
+    }
+
+  template<typename T, std::size_t M, std::size_t N>
+    multi_array<T, M> matvec(const multi_array<T, M, N>& a, const multi_array<T, N>& x,
+                             std::size_t threads = 0)
+    {
+      multi_array<T, M> y;
+      matvec(a, x, y, threads);
+      return y;
+    }
+
+  // Calls f(first, last) on row ranges covering [first, last), on up to
+  // threads threads. Rows are dealt out in blocks of 16, round robin, so
+  // that triangular updates are balanced.
+  template<typename F>
+    void linalg_rows_impl(std::size_t first, std::size_t last, std::size_t threads, F f)
+    {
+      constexpr std::size_t rows = 16;
+      const std::size_t blocks = (last - first + rows - 1) / rows;
+      const std::size_t parts = std::min(thread_count_impl(threads), blocks);
+      if (parts <= 1) {
+        if (first < last) f(first, last);
+        return;
+      }
+      parallel_for_impl(parts, [&](std::size_t t) {
+        for (std::size_t b = t; b < blocks; b += parts)
+          f(first + b * rows, std::min(last, first + (b + 1) * rows));
+      }, "linalg");
+    }
+
+  template<typename T, std::size_t N>
+    void lu_factor_unrolled_impl(multi_array<T, N, N>& a, multi_array<std::size_t, N>& pivots)
+    {
+      unroll_impl<N>([&](auto k) {
+        std::size_t p = k;
+        auto max = std::abs(a[k][k]);
+        unroll_impl<N>([&](auto i) {
+          if constexpr (unrolled_v<decltype(i)> > unrolled_v<decltype(k)>) {
+            const auto v = std::abs(a[i][k]);
+            if (v > max) max = v, p = i;
+          }
+        });
+        if (max == decltype(max){}) throw std::runtime_error("multi_array: singular matrix");
+        pivots[k] = p;
+        if (p != k) a[k].swap(a[p]);
+        const T inverse = T(1) / a[k][k];
+        unroll_impl<N>([&](auto i) {
+          if constexpr (unrolled_v<decltype(i)> > unrolled_v<decltype(k)>) {
+            const T l = a[i][k] *= inverse;
+            unroll_impl<N>([&](auto j) {
+              if constexpr (unrolled_v<decltype(j)> > unrolled_v<decltype(k)>) a[i][j] -= l * a[k][j];
+            });
+          }
+        });
+      });
+    }
+
+  // Factors columns [k0, k1) of the trailing rows of a, with partial
+  // pivoting over whole rows.
+  template<typename T, std::size_t N>
+    void lu_panel_impl(multi_array<T, N, N>& a, multi_array<std::size_t, N>& pivots,
+                       std::size_t k0, std::size_t k1)
+    {
+      for (std::size_t k = k0; k < k1; ++k) {
+        std::size_t p = k;
+        auto max = std::abs(a[k][k]);
+        for (std::size_t i = k + 1; i < N; ++i) {
+          const auto v = std::abs(a[i][k]);
+          if (v > max) max = v, p = i;
+        }
+        if (max == decltype(max){}) throw std::runtime_error("multi_array: singular matrix");
+        pivots[k] = p;
+        if (p != k) a[k].swap(a[p]);
+        const T inverse = T(1) / a[k][k];
+        const T* pivot_row = a[k].data();
+        for (std::size_t i = k + 1; i < N; ++i) {
+          T* row = a[i].data();
+          const T l = row[k] *= inverse;
+          linalg_axpy_impl(row + k + 1, pivot_row + k + 1, l, k1 - k - 1);
+        }
+      }
+    }
+
+  // Blocked LU factorization, block columns at a time, with the trailing
+  // updates on up to threads threads.
+  template<typename T, std::size_t N>
+    void lu_factor_blocked_impl(multi_array<T, N, N>& a, multi_array<std::size_t, N>& pivots,
+                                std::size_t block, std::size_t threads)
+    {
+      for (std::size_t k0 = 0; k0 < N; k0 += block) {
+        const std::size_t k1 = std::min(N, k0 + block);
+        lu_panel_impl(a, pivots, k0, k1);
+        if (k1 == N) break;
+        // U12 = L11^-1 A12
+        for (std::size_t i = k0 + 1; i < k1; ++i) {
+          T* row = a[i].data();
+          for (std::size_t r = k0; r < i; ++r)
+            linalg_axpy_impl(row + k1, a[r].data() + k1, row[r], N - k1);
+        }
+        // A22 -= L21 U12, a column tile at a time so U12 stays in cache.
+        linalg_rows_impl(k1, N, threads, [&](std::size_t first, std::size_t last) {
+          constexpr std::size_t tile = 256;
+          for (std::size_t j = k1; j < N; j += tile) {
+            const std::size_t width = std::min(tile, N - j);
+            for (std::size_t i = first; i < last; ++i) {
+              T* row = a[i].data();
+              for (std::size_t r = k0; r < k1; ++r)
+                linalg_axpy_impl(row + j, a[r].data() + j, row[r], width);
+            }
+          }
+        });
+      }
+    }
+
+  // Factors a = P L U in place: the strict lower triangle of a becomes L
+  // (whose diagonal is all ones), the upper triangle U, and row i was
+  // swapped with row pivots[i] at step i. Throws std::runtime_error if a is
+  // singular. threads bounds the threads used for large a (0: one per
+  // hardware thread).
+  template<typename T, std::size_t N>
+    void lu_factor(multi_array<T, N, N>& a, multi_array<std::size_t, N>& pivots,
+                   std::size_t threads = 0)
+    {
+      TB_MULTI_ARRAY_SPAN("linalg", "lu_factor", static_cast<std::int64_t>(N));
+      TB_MULTI_ARRAY_TIMED(lu_factor);
+      if constexpr (N <= linalg_unroll_limit)
+        lu_factor_unrolled_impl(a, pivots);
+      else
+        lu_factor_blocked_impl(a, pivots, linalg_block_size(),
+                               N < linalg_parallel_rows() ? 1 : threads);
+    }
+
+  // Solves a x = b in place of b, given the factors from lu_factor().
+  template<typename T, std::size_t N>
+    void lu_solve(const multi_array<T, N, N>& lu, const multi_array<std::size_t, N>& pivots,
+                  multi_array<T, N>& b)
+    {
+      TB_MULTI_ARRAY_TIMED(lu_solve);
+      for (std::size_t k = 0; k < N; ++k)
+        if (pivots[k] != k) std::swap(b[k], b[pivots[k]]);
+      for (std::size_t i = 1; i < N; ++i) {
+        const T* row = lu[i].data();
+        T sum = b[i];
+        for (std::size_t j = 0; j < i; ++j) sum -= row[j] * b[j];
+        b[i] = sum;
+      }
+      for (std::size_t i = N; i-- > 0; ) {
+        const T* row = lu[i].data();
+        T sum = b[i];
+        for (std::size_t j = i + 1; j < N; ++j) sum -= row[j] * b[j];
+        b[i] = sum / row[i];
+      }
+    }
+
+  template<typename T, std::size_t N>
+    void cholesky_unrolled_impl(multi_array<T, N, N>& a)
+    {
+      unroll_impl<N>([&](auto k) {
+        if (!(a[k][k] > T(0))) throw std::runtime_error("multi_array: matrix not positive definite");
+        const T d = std::sqrt(a[k][k]);
+        const T inverse = T(1) / d;
+        a[k][k] = d;
+        unroll_impl<N>([&](auto i) {
+          if constexpr (unrolled_v<decltype(i)> > unrolled_v<decltype(k)>) a[i][k] *= inverse;
+        });
+        unroll_impl<N>([&](auto i) {
+          if constexpr (unrolled_v<decltype(i)> > unrolled_v<decltype(k)>)
+            unroll_impl<N>([&](auto j) {
+              if constexpr (unrolled_v<decltype(j)> > unrolled_v<decltype(k)>
+                            && unrolled_v<decltype(j)> <= unrolled_v<decltype(i)>)
+                a[i][j] -= a[i][k] * a[j][k];
+            });
+        });
+      });
+    }
+
+  // Factors the diagonal block [k0, k1) of a, which the trailing updates
+  // of earlier blocks have already been applied to.
+  template<typename T, std::size_t N>
+    void cholesky_block_impl(multi_array<T, N, N>& a, std::size_t k0, std::size_t k1)
+    {
+      for (std::size_t k = k0; k < k1; ++k) {
+        if (!(a[k][k] > T(0))) throw std::runtime_error("multi_array: matrix not positive definite");
+        const T d = std::sqrt(a[k][k]);
+        const T inverse = T(1) / d;
+        a[k][k] = d;
+        for (std::size_t i = k + 1; i < k1; ++i) a[i][k] *= inverse;
+        for (std::size_t i = k + 1; i < k1; ++i)
+          for (std::size_t j = k + 1; j <= i; ++j) a[i][j] -= a[i][k] * a[j][k];
+      }
+    }
+
+  // Blocked Cholesky factorization of the lower triangle, block columns at
+  // a time, with the updates on up to threads threads.
+  template<typename T, std::size_t N>
+    void cholesky_blocked_impl(multi_array<T, N, N>& a, std::size_t block,
+                               std::size_t threads)
+    {
+      std::vector<T> panel;  // L21 transposed, so that updates are contiguous
+      for (std::size_t k0 = 0; k0 < N; k0 += block) {
+        const std::size_t k1 = std::min(N, k0 + block);
+        cholesky_block_impl(a, k0, k1);
+        if (k1 == N) break;
+        const std::size_t rest = N - k1;
+        // L21 = A21 L11^-T
+        linalg_rows_impl(k1, N, threads, [&](std::size_t first, std::size_t last) {
+          for (std::size_t i = first; i < last; ++i) {
+            T* row = a[i].data();
+            for (std::size_t j = k0; j < k1; ++j) {
+              const T* l = a[j].data();
+              T sum = row[j];
+              for (std::size_t r = k0; r < j; ++r) sum -= row[r] * l[r];
+              row[j] = sum / l[j];
+            }
+          }
+        });
+        panel.resize((k1 - k0) * rest);
+        for (std::size_t i = k1; i < N; ++i)
+          for (std::size_t r = k0; r < k1; ++r)
+            panel[(r - k0) * rest + (i - k1)] = a[i][r];
+        // A22 -= L21 L21^T, lower triangle only.
+        linalg_rows_impl(k1, N, threads, [&](std::size_t first, std::size_t last) {
+          for (std::size_t i = first; i < last; ++i) {
+            T* row = a[i].data();
+            for (std::size_t r = k0; r < k1; ++r)
+              linalg_axpy_impl(row + k1, panel.data() + (r - k0) * rest, row[r], i - k1 + 1);
+          }
+        });
+      }
+    }
+
+  // Factors a symmetric positive definite a = L L^T in place: the lower
+  // triangle of a becomes L and the strict upper triangle is zeroed. Only
+  // the lower triangle of a is read. Throws std::runtime_error if a is not
+  // positive definite. threads is as for lu_factor().
+  template<typename T, std::size_t N>
+    void cholesky(multi_array<T, N, N>& a, std::size_t threads = 0)
+    {
+      TB_MULTI_ARRAY_SPAN("linalg", "cholesky", static_cast<std::int64_t>(N));
+      TB_MULTI_ARRAY_TIMED(cholesky);
+      if constexpr (N <= linalg_unroll_limit)
+        cholesky_unrolled_impl(a);
+      else
+        cholesky_blocked_impl(a, linalg_block_size(),
+                              N < linalg_parallel_rows() ? 1 : threads);
+      for (std::size_t i = 0; i < N; ++i)
+        std::fill(a[i].data() + i + 1, a[i].data() + N, T(0));
+    }
+
+  // Solves l l^T x = b in place of b, given the factor from cholesky().
+  template<typename T, std::size_t N>
+    void cholesky_solve(const multi_array<T, N, N>& l, multi_array<T, N>& b)
+    {
+      TB_MULTI_ARRAY_TIMED(cholesky_solve);
+      for (std::size_t i = 0; i < N; ++i) {
+        const T* row = l[i].data();
+        T sum = b[i];
+        for (std::size_t j = 0; j < i; ++j) sum -= row[j] * b[j];
+        b[i] = sum / row[i];
+      }
+      for (std::size_t i = N; i-- > 0; ) {
+        T sum = b[i];
+        for (std::size_t j = i + 1; j < N; ++j) sum -= l[j][i] * b[j];
+        b[i] = sum / l[i][i];
+      }
+    }
+
+  // Factors a diagonally dominant N x N matrix with the given block size
+  // and threads, for the tuners.
+  template<std::size_t N>
+    void linalg_tuning_lu_impl(std::size_t block, std::size_t threads)
+    {
+      using matrix = multi_array<double, N, N>;
+      static const std::unique_ptr<const matrix> input = [] {
+        auto a = std::make_unique<matrix>();
+        for (std::size_t i = 0; i < N; ++i)
+          for (std::size_t j = 0; j < N; ++j)
+            (*a)[i][j] = i == j ? 2.0 * N : 1.0 / double(1 + (i * 7 + j * 13) % 17);
+        return a;
+      }();
+      static const auto a = std::make_unique<matrix>();
+      static const auto pivots = std::make_unique<multi_array<std::size_t, N>>();
+      *a = *input;
+      lu_factor_blocked_impl(*a, *pivots, block, threads);
+    }
+
+  // Multiplies an M x 1024 float matrix by a vector in parts bands.
+  template<std::size_t M>
+    void linalg_tuning_matvec_impl(std::size_t parts)
+    {
+      static const auto a = std::make_unique<multi_array<float, M, 1024>>();
+      static const auto x = std::make_unique<multi_array<float, 1024>>();
+      static const auto y = std::make_unique<multi_array<float, M>>();
+      matvec_impl(*a, *x, *y, parts);
+    }
+
+  inline long tune_linalg_block_impl()
+  {
+    return fastest_candidate({ 16, 32, 64, 128 }, [](long b) {
+      linalg_tuning_lu_impl<512>(b, 1);
+    });
+  }
+
+  // Smallest order at which factoring on two threads beats one; 1024 if
+  // none of the candidates does.
+  inline long tune_linalg_parallel_min_impl()
+  {
+    if (std::thread::hardware_concurrency() < 2) return 1024;
+    const std::size_t block = linalg_block_size();
+    auto threads_win = [block](void (*lu)(std::size_t, std::size_t)) {
+      return fastest_candidate({ 1, 2 }, [&](long t) { lu(block, t); }, 5) == 2;
+    };
+    if (threads_win(linalg_tuning_lu_impl<128>)) return 128;
+    if (threads_win(linalg_tuning_lu_impl<256>)) return 256;
+    if (threads_win(linalg_tuning_lu_impl<512>)) return 512;
+    return 1024;
+  }
+
+  // Smallest share of a matrix-vector product at which splitting it
+  // between two threads beats one; the largest candidate if it never does.
+  inline long tune_linalg_parallel_bytes_impl()
+  {
+    if (std::thread::hardware_concurrency() < 2) return 1l << 24;
+    // Products of twice the candidate share, 4 KiB per row.
+    auto threads_win = [](void (*matvec)(std::size_t)) {
+      return fastest_candidate({ 1, 2 }, [&](long t) { matvec(t); }, 5) == 2;
+    };
+    if (threads_win(linalg_tuning_matvec_impl<512>)) return 1l << 20;
+    if (threads_win(linalg_tuning_matvec_impl<2048>)) return 1l << 22;
+    return 1l << 24;
+  }
+
+  inline const bool linalg_tuners_registered_impl
+    = register_tuner("linalg.block", tune_linalg_block_impl)
+      && register_tuner("linalg.parallel_min", tune_linalg_parallel_min_impl)
+      && register_tuner("linalg.parallel_bytes", tune_linalg_parallel_bytes_impl);
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_LINALG_H
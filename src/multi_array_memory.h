@@ -0,0 +1,277 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Memory footprint introspection. footprint() describes where an array's
+// storage lives: its logical and allocated size, padding, cache-line and
+// page spans, residency and huge-page backing. Defining
+// TB_MULTI_ARRAY_MEMORY_REGISTRY before including multi_array.h also keeps
+// a process-wide tally of live multi_arrays by type (sub-arrays are counted
+// as part of their parent, not on their own).
+
+#ifndef TB_MULTI_ARRAY_MEMORY_H
+#define TB_MULTI_ARRAY_MEMORY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <vector>
+
+#if defined(__linux__)
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
+namespace tb {
+
+  template<typename T, std::size_t M, std::size_t... N> class multi_array;
+  template<typename T> struct text_table;
+
+  inline constexpr std::size_t cache_line_size = 64;
+
+  enum class huge_page_backing {
+    unknown,      // not determinable on this platform
+    none,
+    transparent,  // the containing mapping holds transparent huge pages
+    hugetlb       // the mapping uses a huge page size (hugetlbfs)
+  };
+
+  struct memory_footprint {
+    std::size_t logical_bytes = 0;    // element count * sizeof(element)
+    std::size_t allocated_bytes = 0;  // bytes reserved for the storage
+    std::size_t padding_bytes = 0;    // allocated - logical
+    std::size_t alignment = 0;        // largest power of two dividing the address
+    std::size_t cache_lines = 0;      // cache lines spanned by the logical bytes
+    std::size_t alignment_waste = 0;  // cache_lines * line size - logical bytes
+    std::size_t page_size = 0;
+    std::size_t pages = 0;            // pages spanned by the logical bytes
+    std::size_t resident_pages = 0;   // of those, currently in memory
+    huge_page_backing huge_pages = huge_page_backing::unknown;
+  };
+
+  inline std::size_t page_size_impl() noexcept
+  {
+#if defined(__linux__)
+    static const std::size_t size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+#else
+    return 4096;
+#endif
+  }
+
+  // Looks up the mapping containing address in /proc/self/smaps.
+  inline huge_page_backing huge_page_backing_impl(std::uintptr_t address)
+  {
+#if defined(__linux__)
+    std::FILE* f = std::fopen("/proc/self/smaps", "r");
+    if (!f) return huge_page_backing::unknown;
+    huge_page_backing result = huge_page_backing::unknown;
+    bool inside = false;
+    char line[512];
+    while (std::fgets(line, sizeof line, f)) {
+      unsigned long long first, last, kb;
+      if (std::sscanf(line, "%llx-%llx ", &first, &last) == 2) {
+        if (inside) break;
+        inside = address >= first && address < last;
+        if (inside) result = huge_page_backing::none;
+      } else if (inside && std::sscanf(line, "KernelPageSize: %llu kB", &kb) == 1) {
+        if (kb * 1024 > page_size_impl()) result = huge_page_backing::hugetlb;
+      } else if (inside && std::sscanf(line, "AnonHugePages: %llu kB", &kb) == 1) {
+        if (kb > 0 && result == huge_page_backing::none)
+          result = huge_page_backing::transparent;
+      }
+    }
+    std::fclose(f);
+    return result;
+#else
+    (void)address;
+    return huge_page_backing::unknown;
+#endif
+  }
+
+  // Footprint of logical bytes at p inside an allocation of allocated bytes.
+  inline memory_footprint
+  footprint(const void* p, std::size_t logical, std::size_t allocated)
+  {
+    memory_footprint f;
+    const auto address = reinterpret_cast<std::uintptr_t>(p);
+    f.logical_bytes = logical;
+    f.allocated_bytes = allocated;
+    f.padding_bytes = allocated > logical ? allocated - logical : 0;
+    f.alignment = address & -address;
+    f.page_size = page_size_impl();
+    if (logical == 0 || address == 0) return f;
+
+    const std::uintptr_t end = address + logical;
+    const std::uintptr_t line = address / cache_line_size;
+    f.cache_lines = (end - 1) / cache_line_size - line + 1;
+    f.alignment_waste = f.cache_lines * cache_line_size - logical;
+    const std::uintptr_t page = address / f.page_size;
+    f.pages = (end - 1) / f.page_size - page + 1;
+#if defined(__linux__)
+    std::vector<unsigned char> residency(f.pages);
+    if (::mincore(reinterpret_cast<void*>(page * f.page_size), f.pages * f.page_size,
+                  residency.data()) == 0)
+      f.resident_pages = std::count_if(residency.begin(), residency.end(),
+                                       [](unsigned char r) { return r & 1; });
+#endif
+    f.huge_pages = huge_page_backing_impl(address);
+    return f;
+  }
+
+  // Inline storage: everything in the object is allocated for the array.
+  template<typename T, std::size_t M, std::size_t... N>
+    memory_footprint footprint(const multi_array<T, M, N...>& a)
+    {
+      using A = multi_array<T, M, N...>;
+      return footprint(&a, A::total_size() * sizeof(T), sizeof(A));
+    }
+
+  // Heap storage of a text_table; unused vector capacity is padding.
+  template<typename T>
+    memory_footprint footprint(const text_table<T>& t)
+    {
+      return footprint(t.values.data(), t.values.size() * sizeof(T),
+                       t.values.capacity() * sizeof(T));
+    }
+
+  // Live multi_arrays of one type.
+  struct memory_usage {
+    const std::type_info* type = nullptr;
+    std::size_t live_arrays = 0;
+    std::size_t live_bytes = 0;
+    std::size_t peak_bytes = 0;
+  };
+
+  struct memory_registry_impl {
+    struct object { const std::type_info* type; std::size_t size; };
+
+    std::mutex mutex;
+    std::map<std::uintptr_t, object> objects;  // by address
+    std::map<std::type_index, memory_usage> types;
+
+    static memory_registry_impl& get()
+    {
+      static memory_registry_impl instance;
+      return instance;
+    }
+
+    // True if [address, address + size) lies within a registered object.
+    bool contained(std::uintptr_t address, std::size_t size) const
+    {
+      auto it = objects.upper_bound(address);
+      if (it == objects.begin()) return false;
+      --it;
+      return address + size <= it->first + it->second.size;
+    }
+
+    void add(const void* p, const std::type_info& type, std::size_t size)
+    {
+      const auto address = reinterpret_cast<std::uintptr_t>(p);
+      std::lock_guard lock(mutex);
+      if (contained(address, size)) return;  // sub-array or re-construction
+      objects.emplace(address, object{ &type, size });
+      memory_usage& u = types[type];
+      u.type = &type;
+      ++u.live_arrays;
+      u.live_bytes += size;
+      u.peak_bytes = std::max(u.peak_bytes, u.live_bytes);
+    }
+
+    void remove(const void* p, const std::type_info& type) noexcept
+    {
+      const auto address = reinterpret_cast<std::uintptr_t>(p);
+      std::lock_guard lock(mutex);
+      auto it = objects.find(address);
+      if (it == objects.end() || *it->second.type != type) return;
+      memory_usage& u = types[type];
+      --u.live_arrays;
+      u.live_bytes -= it->second.size;
+      objects.erase(it);
+    }
+  };
+
+  // Base of every multi_array under TB_MULTI_ARRAY_MEMORY_REGISTRY. Being
+  // empty and first, it shares the array's address, and it is constructed
+  // before and destroyed after the sub-arrays, which therefore find their
+  // parent registered and are not counted twice. Arrays constructed during
+  // constant evaluation are not registered.
+  template<typename A>
+    class memory_registration {
+    protected:
+      constexpr memory_registration() noexcept
+      {
+        if (std::is_constant_evaluated()) return;
+        try { memory_registry_impl::get().add(this, typeid(A), sizeof(A)); }
+        catch (...) {}
+      }
+
+      constexpr memory_registration(const memory_registration&) noexcept
+        : memory_registration() {}
+
+      constexpr memory_registration&
+      operator=(const memory_registration&) noexcept { return *this; }
+
+      constexpr ~memory_registration()
+      {
+        if (!std::is_constant_evaluated())
+          memory_registry_impl::get().remove(this, typeid(A));
+      }
+    };
+
+  // Live multi_array memory by type, largest first.
+  inline std::vector<memory_usage> memory_snapshot()
+  {
+    auto& registry = memory_registry_impl::get();
+    std::vector<memory_usage> result;
+    {
+      std::lock_guard lock(registry.mutex);
+      for (const auto& entry : registry.types) result.push_back(entry.second);
+    }
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+      return a.live_bytes > b.live_bytes;
+    });
+    return result;
+  }
+
+  inline std::size_t live_array_bytes()
+  {
+    std::size_t total = 0;
+    for (const auto& u : memory_snapshot()) total += u.live_bytes;
+    return total;
+  }
+
+  inline void memory_report(std::FILE* out = stderr)
+  {
+    for (const auto& u : memory_snapshot())
+      std::fprintf(out, "%s: live %zu, bytes %zu, peak %zu\n", u.type->name(),
+                   u.live_arrays, u.live_bytes, u.peak_bytes);
+  }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_MEMORY_H
@@ -0,0 +1,316 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Morton (Z-order) encoding of 2D and 3D indices, and morton_array, a grid
+// stored in Z-order. Encoding uses the BMI2 pdep/pext instructions when
+// compiled for them (-mbmi2 or -march=haswell and later) and magic-bit
+// shifts otherwise; both give identical results.
+
+#ifndef TB_MULTI_ARRAY_MORTON_H
+#define TB_MULTI_ARRAY_MORTON_H
+
+#include "multi_array.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__BMI2__)
+#  include <immintrin.h>
+#endif
+
+namespace tb {
+
+  // Spreads the low 32 bits of x to the even bits.
+  constexpr std::uint64_t morton_spread2_impl(std::uint64_t x) noexcept
+  {
+    x &= 0xFFFFFFFFu;
+    x = (x | x << 16) & 0x0000FFFF0000FFFFull;
+    x = (x | x << 8)  & 0x00FF00FF00FF00FFull;
+    x = (x | x << 4)  & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | x << 2)  & 0x3333333333333333ull;
+    x = (x | x << 1)  & 0x5555555555555555ull;
+    return x;
+  }
+
+  constexpr std::uint32_t morton_compact2_impl(std::uint64_t x) noexcept
+  {
+    x &= 0x5555555555555555ull;
+    x = (x ^ x >> 1)  & 0x3333333333333333ull;
+    x = (x ^ x >> 2)  & 0x0F0F0F0F0F0F0F0Full;
+    x = (x ^ x >> 4)  & 0x00FF00FF00FF00FFull;
+    x = (x ^ x >> 8)  & 0x0000FFFF0000FFFFull;
+    x = (x ^ x >> 16) & 0x00000000FFFFFFFFull;
+    return static_cast<std::uint32_t>(x);
+  }
+
+  // Spreads the low 21 bits of x to every third bit.
+  constexpr std::uint64_t morton_spread3_impl(std::uint64_t x) noexcept
+  {
+    x &= 0x1FFFFF;
+    x = (x | x << 32) & 0x001F00000000FFFFull;
+    x = (x | x << 16) & 0x001F0000FF0000FFull;
+    x = (x | x << 8)  & 0x100F00F00F00F00Full;
+    x = (x | x << 4)  & 0x10C30C30C30C30C3ull;
+    x = (x | x << 2)  & 0x1249249249249249ull;
+    return x;
+  }
+
+  constexpr std::uint32_t morton_compact3_impl(std::uint64_t x) noexcept
+  {
+    x &= 0x1249249249249249ull;
+    x = (x ^ x >> 2)  & 0x10C30C30C30C30C3ull;
+    x = (x ^ x >> 4)  & 0x100F00F00F00F00Full;
+    x = (x ^ x >> 8)  & 0x001F0000FF0000FFull;
+    x = (x ^ x >> 16) & 0x001F00000000FFFFull;
+    x = (x ^ x >> 32) & 0x00000000001FFFFFull;
+    return static_cast<std::uint32_t>(x);
+  }
+
+  inline constexpr std::uint64_t morton_mask2 = 0x5555555555555555ull;
+  inline constexpr std::uint64_t morton_mask3 = 0x1249249249249249ull;
+
+  // Interleaves x (even bits) and y (odd bits).
+  constexpr std::uint64_t morton_encode(std::uint32_t x, std::uint32_t y) noexcept
+  {
+#if defined(__BMI2__)
+    if (!std::is_constant_evaluated())
+      return _pdep_u64(x, morton_mask2) | _pdep_u64(y, morton_mask2 << 1);
+#endif
+    return morton_spread2_impl(x) | morton_spread2_impl(y) << 1;
+  }
+
+  // Interleaves the low 21 bits of x, y and z, x in the lowest bit.
+  constexpr std::uint64_t
+  morton_encode(std::uint32_t x, std::uint32_t y, std::uint32_t z) noexcept
+  {
+#if defined(__BMI2__)
+    if (!std::is_constant_evaluated())
+      return _pdep_u64(x, morton_mask3) | _pdep_u64(y, morton_mask3 << 1)
+             | _pdep_u64(z, morton_mask3 << 2);
+#endif
+    return morton_spread3_impl(x) | morton_spread3_impl(y) << 1
+           | morton_spread3_impl(z) << 2;
+  }
+
+  // Inverse of morton_encode(x, y): returns { x, y }.
+  constexpr std::array<std::uint32_t, 2> morton_decode2(std::uint64_t code) noexcept
+  {
+#if defined(__BMI2__)
+    if (!std::is_constant_evaluated())
+      return { static_cast<std::uint32_t>(_pext_u64(code, morton_mask2)),
+               static_cast<std::uint32_t>(_pext_u64(code, morton_mask2 << 1)) };
+#endif
+    return { morton_compact2_impl(code), morton_compact2_impl(code >> 1) };
+  }
+
+  // Inverse of morton_encode(x, y, z): returns { x, y, z }.
+  constexpr std::array<std::uint32_t, 3> morton_decode3(std::uint64_t code) noexcept
+  {
+#if defined(__BMI2__)
+    if (!std::is_constant_evaluated())
+      return { static_cast<std::uint32_t>(_pext_u64(code, morton_mask3)),
+               static_cast<std::uint32_t>(_pext_u64(code, morton_mask3 << 1)),
+               static_cast<std::uint32_t>(_pext_u64(code, morton_mask3 << 2)) };
+#endif
+    return { morton_compact3_impl(code), morton_compact3_impl(code >> 1),
+             morton_compact3_impl(code >> 2) };
+  }
+
+  static_assert(morton_encode(0b11, 0b00) == 0b0101);
+  static_assert(morton_encode(1, 2, 4) == 0b100010001);
+  static_assert(morton_decode2(morton_encode(12345, 678)) == std::array<std::uint32_t, 2>{ 12345, 678 });
+
+  // Scatters the low bits of x to the set bits of mask, like pdep.
+  constexpr std::uint64_t morton_deposit_impl(std::uint64_t x, std::uint64_t mask) noexcept
+  {
+#if defined(__BMI2__)
+    if (!std::is_constant_evaluated()) return _pdep_u64(x, mask);
+#endif
+    std::uint64_t result = 0;
+    for (std::uint64_t bit = 1; mask != 0; bit <<= 1, mask &= mask - 1)
+      if (x & bit) result |= mask & -mask;
+    return result;
+  }
+
+  // Gathers the bits of x selected by mask into the low bits, like pext.
+  constexpr std::uint64_t morton_extract_impl(std::uint64_t x, std::uint64_t mask) noexcept
+  {
+#if defined(__BMI2__)
+    if (!std::is_constant_evaluated()) return _pext_u64(x, mask);
+#endif
+    std::uint64_t result = 0;
+    for (std::uint64_t bit = 1; mask != 0; bit <<= 1, mask &= mask - 1)
+      if (x & mask & -mask) result |= bit;
+    return result;
+  }
+
+  // Bit masks of each dimension of a Morton grid with the given extents,
+  // innermost dimension first. Bits are dealt round-robin, innermost first,
+  // among the dimensions that still have bits left, so unequal powers of
+  // two interleave without gaps. For equal extents these are the masks of
+  // morton_encode().
+  template<std::size_t... E>
+    consteval auto morton_masks_impl()
+    {
+      constexpr std::size_t rank = sizeof...(E);
+      const std::size_t extents[] = { E... };
+      std::array<std::uint64_t, rank> masks{};
+      unsigned position = 0;
+      for (unsigned bit = 0; bit < 64; ++bit)
+        for (std::size_t d = 0; d < rank; ++d)
+          if ((std::size_t{1} << bit) < extents[rank - 1 - d])
+            masks[d] |= std::uint64_t{1} << position++;
+      return masks;
+    }
+
+  // Grid of rank 2 or 3 stored in Morton order. Every extent must be a power
+  // of two. The innermost index takes the lowest bit, so for square and
+  // cubic grids a(i, j) lives at morton_encode(j, i) and a(i, j, k) at
+  // morton_encode(k, j, i); other shapes interleave the bits they have.
+  // Iteration visits the elements in storage (Z-) order.
+  template<typename T, std::size_t... E>
+      requires (sizeof...(E) == 2 || sizeof...(E) == 3)
+    class morton_array {
+    public:
+      static_assert((std::has_single_bit(E) && ...),
+                    "morton_array extents must be powers of two");
+
+      using element_type    = T;
+      using value_type      = T;
+      using reference       = T&;
+      using const_reference = const T&;
+      using iterator        = T*;
+      using const_iterator  = const T*;
+      using size_type       = std::size_t;
+
+      static consteval auto order() { return sizeof...(E); }
+      static consteval auto total_size() { return (E * ...); }
+
+      static constexpr auto masks = morton_masks_impl<E...>();
+      static constexpr bool cubic = ((E == std::max({ E... })) && ...);
+
+      // Storage index of an element.
+      static constexpr std::uint64_t index(std::size_t i, std::size_t j) noexcept
+        requires (sizeof...(E) == 2)
+      {
+        if constexpr (cubic)
+          return morton_encode(static_cast<std::uint32_t>(j), static_cast<std::uint32_t>(i));
+        else
+          return morton_deposit_impl(j, masks[0]) | morton_deposit_impl(i, masks[1]);
+      }
+
+      static constexpr std::uint64_t
+      index(std::size_t i, std::size_t j, std::size_t k) noexcept
+        requires (sizeof...(E) == 3)
+      {
+        if constexpr (cubic)
+          return morton_encode(static_cast<std::uint32_t>(k), static_cast<std::uint32_t>(j),
+                               static_cast<std::uint32_t>(i));
+        else
+          return morton_deposit_impl(k, masks[0]) | morton_deposit_impl(j, masks[1])
+                 | morton_deposit_impl(i, masks[2]);
+      }
+
+      constexpr morton_array() = default;
+
+      constexpr morton_array(const T& value)
+      { std::fill(data_, data_ + total_size(), value); }
+
+      template<Index_type... I>
+          requires (sizeof...(I) == sizeof...(E))
+        constexpr reference operator()(I... i) noexcept
+        { return data_[index(i...)]; }
+
+      template<Index_type... I>
+          requires (sizeof...(I) == sizeof...(E))
+        constexpr const_reference operator()(I... i) const noexcept
+        { return data_[index(i...)]; }
+
+      constexpr iterator begin() noexcept { return data_; }
+      constexpr const_iterator begin() const noexcept { return data_; }
+      constexpr iterator end() noexcept { return data_ + total_size(); }
+      constexpr const_iterator end() const noexcept { return data_ + total_size(); }
+
+      constexpr T* data() noexcept { return data_; }
+      constexpr const T* data() const noexcept { return data_; }
+
+      constexpr void fill(const T& value)
+      { std::fill(data_, data_ + total_size(), value); }
+
+      constexpr void swap(morton_array& a) noexcept
+      { std::swap_ranges(data_, data_ + total_size(), a.data_); }
+
+      friend constexpr bool
+      operator==(const morton_array& a, const morton_array& b)
+      { return std::equal(a.data_, a.data_ + total_size(), b.data_); }
+
+    private:
+      T data_[total_size()];
+    };
+
+  // Copies a row-major multi_array into Morton order.
+  template<typename T, std::size_t M, std::size_t N>
+    constexpr morton_array<T, M, N> to_morton(const multi_array<T, M, N>& a)
+    {
+      morton_array<T, M, N> result;
+      for (std::size_t i = 0; i < M; ++i)
+        for (std::size_t j = 0; j < N; ++j)
+          result(i, j) = a[i][j];
+      return result;
+    }
+
+  template<typename T, std::size_t L, std::size_t M, std::size_t N>
+    constexpr morton_array<T, L, M, N> to_morton(const multi_array<T, L, M, N>& a)
+    {
+      morton_array<T, L, M, N> result;
+      for (std::size_t i = 0; i < L; ++i)
+        for (std::size_t j = 0; j < M; ++j)
+          for (std::size_t k = 0; k < N; ++k)
+            result(i, j, k) = a[i][j][k];
+      return result;
+    }
+
+  // Copies a Morton-order grid back into a row-major multi_array.
+  template<typename T, std::size_t... E>
+    constexpr multi_array<T, E...> to_multi_array(const morton_array<T, E...>& a)
+    {
+      multi_array<T, E...> result;
+      constexpr std::size_t e[] = { E... };
+      if constexpr (sizeof...(E) == 2) {
+        for (std::size_t i = 0; i < e[0]; ++i)
+          for (std::size_t j = 0; j < e[1]; ++j)
+            result[i][j] = a(i, j);
+      } else {
+        for (std::size_t i = 0; i < e[0]; ++i)
+          for (std::size_t j = 0; j < e[1]; ++j)
+            for (std::size_t k = 0; k < e[2]; ++k)
+              result[i][j][k] = a(i, j, k);
+      }
+      return result;
+    }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_MORTON_H
@@ -0,0 +1,171 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Non-temporal store kernels, which write data larger than the last-level
+// cache around it. multi_array::fill() and swap() use them above
+// stream_threshold(), as does multi_array_stream.h. Only SSE2 has them;
+// elsewhere they are the ordinary copy, fill and swap, and this header
+// includes nothing beyond the standard library.
+
+#ifndef TB_MULTI_ARRAY_NONTEMPORAL_H
+#define TB_MULTI_ARRAY_NONTEMPORAL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  if __has_include(<cpuid.h>)
+#    include <cpuid.h>
+#    define TB_MULTI_ARRAY_HAS_CPUID 1
+#  endif
+#endif
+
+namespace tb {
+
+  // Size in bytes of the largest cache, or 32 MiB if it cannot be found.
+  inline std::size_t llc_size() noexcept
+  {
+    static const std::size_t size = [] {
+      std::size_t bytes = 0;
+#ifdef TB_MULTI_ARRAY_HAS_CPUID
+      // Deterministic cache parameters: leaf 4 on Intel, 0x8000001d on AMD.
+      for (unsigned leaf : { 4u, 0x8000001du }) {
+        if (__get_cpuid_max(leaf & 0x80000000u, nullptr) < leaf) continue;
+        for (unsigned i = 0; i < 16; ++i) {
+          unsigned a, b, c, d;
+          __cpuid_count(leaf, i, a, b, c, d);
+          if ((a & 0x1f) == 0) break;  // no more caches
+          const std::size_t ways = (b >> 22) + 1, partitions = ((b >> 12) & 0x3ff) + 1;
+          const std::size_t line = (b & 0xfff) + 1, sets = std::size_t{c} + 1;
+          bytes = std::max(bytes, ways * partitions * line * sets);
+        }
+        if (bytes > 0) break;
+      }
+#endif
+      return bytes > 0 ? bytes : std::size_t{32} << 20;
+    }();
+    return size;
+  }
+
+  inline std::atomic<std::size_t>& stream_threshold_impl() noexcept
+  {
+    static std::atomic<std::size_t> bytes{llc_size()};
+    return bytes;
+  }
+
+  // Arrays of at least this many bytes are streamed; by default the size
+  // of the largest cache.
+  inline std::size_t stream_threshold() noexcept
+  { return stream_threshold_impl().load(std::memory_order_relaxed); }
+
+  // Replaces stream_threshold(), e.g. with a smaller value on a machine
+  // whose cache is shared with other work, or with SIZE_MAX to never
+  // stream.
+  inline void set_stream_threshold(std::size_t bytes) noexcept
+  { stream_threshold_impl().store(bytes, std::memory_order_relaxed); }
+
+  inline bool aligned_impl(const void* p, std::size_t alignment) noexcept
+  { return reinterpret_cast<std::uintptr_t>(p) % alignment == 0; }
+
+  inline void stream_copy_bytes_impl(char* dst, const char* src, std::size_t n) noexcept
+  {
+#if defined(__SSE2__)
+    const std::size_t head = std::min(n, (16 - reinterpret_cast<std::uintptr_t>(dst) % 16) % 16);
+    std::memcpy(dst, src, head);
+    dst += head, src += head, n -= head;
+    for (; n >= 64; dst += 64, src += 64, n -= 64) {
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+      const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+      const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 48));
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst), a);
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 16), b);
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 32), c);
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst + 48), d);
+    }
+    for (; n >= 16; dst += 16, src += 16, n -= 16)
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst),
+                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    std::memcpy(dst, src, n);
+    _mm_sfence();
+#else
+    std::memcpy(dst, src, n);
+#endif
+  }
+
+  template<typename T>
+    void stream_fill_impl(T* first, std::size_t n, const T& value) noexcept
+    {
+#if defined(__SSE2__)
+      if constexpr (16 % sizeof(T) == 0) {
+        if (aligned_impl(first, sizeof(T))) {
+          constexpr std::size_t per = 16 / sizeof(T);
+          for (; n > 0 && !aligned_impl(first, 16); --n) *first++ = value;
+          T pattern[per];
+          std::fill_n(pattern, per, value);
+          __m128i v;
+          std::memcpy(&v, pattern, 16);
+          for (; n >= 4 * per; first += 4 * per, n -= 4 * per) {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(first), v);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(first + per), v);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(first + 2 * per), v);
+            _mm_stream_si128(reinterpret_cast<__m128i*>(first + 3 * per), v);
+          }
+          for (; n >= per; first += per, n -= per)
+            _mm_stream_si128(reinterpret_cast<__m128i*>(first), v);
+          std::fill_n(first, n, value);
+          _mm_sfence();
+          return;
+        }
+      }
+#endif
+      std::fill_n(first, n, value);
+    }
+
+  inline void stream_swap_bytes_impl(char* a, char* b, std::size_t n) noexcept
+  {
+#if defined(__SSE2__)
+    if ((reinterpret_cast<std::uintptr_t>(a) - reinterpret_cast<std::uintptr_t>(b)) % 16 == 0) {
+      const std::size_t head = std::min(n, (16 - reinterpret_cast<std::uintptr_t>(a) % 16) % 16);
+      std::swap_ranges(a, a + head, b);
+      a += head, b += head, n -= head;
+      for (; n >= 16; a += 16, b += 16, n -= 16) {
+        const __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(a));
+        const __m128i y = _mm_load_si128(reinterpret_cast<const __m128i*>(b));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(a), y);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(b), x);
+      }
+      std::swap_ranges(a, a + n, b);
+      _mm_sfence();
+      return;
+    }
+#endif
+    std::swap_ranges(a, a + n, b);
+  }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_NONTEMPORAL_H
@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Space-filling-curve traversal of row-major multi_arrays of rank 2 and 3.
+// for_each(a, order::morton, f) and for_each(a, order::hilbert, f) visit
+// every element once in Z- or Hilbert order without changing the storage
+// layout, so that elements visited close together in time are also close
+// in space in every dimension.
+
+#ifndef TB_MULTI_ARRAY_ORDER_H
+#define TB_MULTI_ARRAY_ORDER_H
+
+#include "multi_array.h"
+#include "multi_array_morton.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace tb {
+
+  enum class order { row_major, morton, hilbert };
+
+  // Calls f(element, i, j...) if f accepts the indices, f(element) otherwise.
+  template<typename A, typename F, typename... I>
+    constexpr void visit_element_impl(A& a, F& f, I... i)
+    {
+      auto& element = a(i...);
+      if constexpr (std::is_invocable_v<F&, decltype(element), I...>) f(element, i...);
+      else f(element);
+    }
+
+  template<typename A, typename F>
+    constexpr void for_each_row_major_impl(A& a, F& f)
+    {
+      using B = std::remove_const_t<A>;
+      constexpr auto e = multi_array_extents_v<B>;
+      if constexpr (e.size() == 2) {
+        for (std::size_t i = 0; i < e[0]; ++i)
+          for (std::size_t j = 0; j < e[1]; ++j)
+            visit_element_impl(a, f, i, j);
+      } else {
+        for (std::size_t i = 0; i < e[0]; ++i)
+          for (std::size_t j = 0; j < e[1]; ++j)
+            for (std::size_t k = 0; k < e[2]; ++k)
+              visit_element_impl(a, f, i, j, k);
+      }
+    }
+
+  // Z-order over the extents rounded up to powers of two, with bits dealt
+  // as in morton_array; codes outside the array are skipped, at most 2^rank
+  // per element.
+  template<typename A, typename F>
+    constexpr void for_each_morton_impl(A& a, F& f)
+    {
+      using B = std::remove_const_t<A>;
+      constexpr auto e = multi_array_extents_v<B>;
+      if constexpr (e.size() == 2) {
+        constexpr auto masks = morton_masks_impl<std::bit_ceil(e[0]), std::bit_ceil(e[1])>();
+        constexpr std::uint64_t codes = std::bit_ceil(e[0]) * std::bit_ceil(e[1]);
+        for (std::uint64_t c = 0; c < codes; ++c) {
+          const std::size_t i = morton_extract_impl(c, masks[1]);
+          const std::size_t j = morton_extract_impl(c, masks[0]);
+          if (i < e[0] && j < e[1]) visit_element_impl(a, f, i, j);
+        }
+      } else {
+        constexpr auto masks = morton_masks_impl<std::bit_ceil(e[0]), std::bit_ceil(e[1]),
+                                                 std::bit_ceil(e[2])>();
+        constexpr std::uint64_t codes
+          = std::bit_ceil(e[0]) * std::bit_ceil(e[1]) * std::bit_ceil(e[2]);
+        for (std::uint64_t c = 0; c < codes; ++c) {
+          const std::size_t i = morton_extract_impl(c, masks[2]);
+          const std::size_t j = morton_extract_impl(c, masks[1]);
+          const std::size_t k = morton_extract_impl(c, masks[0]);
+          if (i < e[0] && j < e[1] && k < e[2]) visit_element_impl(a, f, i, j, k);
+        }
+      }
+    }
+
+  // Converts a Hilbert index of a cube with side 2^bits in R dimensions to
+  // coordinates (J. Skilling, "Programming the Hilbert curve", 2004).
+  template<std::size_t R>
+    constexpr void hilbert_axes_impl(std::uint64_t h, unsigned bits, std::uint32_t (&x)[R])
+    {
+      for (std::size_t d = 0; d < R; ++d) x[d] = 0;
+      for (unsigned b = 0; b < bits; ++b)
+        for (std::size_t d = 0; d < R; ++d)
+          x[d] |= static_cast<std::uint32_t>((h >> (b * R + (R - 1 - d))) & 1) << b;
+
+      const std::uint32_t n = std::uint32_t{2} << (bits - 1);
+      std::uint32_t t = x[R - 1] >> 1;
+      for (std::size_t d = R - 1; d > 0; --d) x[d] ^= x[d - 1];
+      x[0] ^= t;
+      for (std::uint32_t q = 2; q != n; q <<= 1) {
+        const std::uint32_t p = q - 1;
+        for (std::size_t d = R; d-- > 0; ) {
+          if (x[d] & q) {
+            x[0] ^= p;
+          } else {
+            t = (x[0] ^ x[d]) & p;
+            x[0] ^= t;
+            x[d] ^= t;
+          }
+        }
+      }
+    }
+
+  // Hilbert order. The array is covered by cubes whose side is the
+  // smallest extent rounded up to a power of two, visited in row-major
+  // order; each cube is traversed along a Hilbert curve, skipping points
+  // outside the array.
+  template<typename A, typename F>
+    constexpr void for_each_hilbert_impl(A& a, F& f)
+    {
+      using B = std::remove_const_t<A>;
+      constexpr auto e = multi_array_extents_v<B>;
+      constexpr std::size_t rank = e.size();
+      constexpr std::size_t side = std::bit_ceil(*std::min_element(e.begin(), e.end()));
+      if constexpr (side == 1) {
+        for_each_row_major_impl(a, f);
+      } else {
+        constexpr unsigned bits = std::countr_zero(side);
+        constexpr std::uint64_t points = std::uint64_t{1} << (bits * rank);
+        std::size_t blocks[rank];
+        for (std::size_t d = 0; d < rank; ++d) blocks[d] = (e[d] + side - 1) / side;
+        std::size_t block_count = 1;
+        for (std::size_t d = 0; d < rank; ++d) block_count *= blocks[d];
+        for (std::size_t b = 0; b < block_count; ++b) {
+          std::size_t origin[rank];
+          for (std::size_t d = rank, rest = b; d-- > 0; rest /= blocks[d])
+            origin[d] = rest % blocks[d] * side;
+          for (std::uint64_t h = 0; h < points; ++h) {
+            std::uint32_t x[rank];
+            hilbert_axes_impl(h, bits, x);
+            std::size_t idx[rank];
+            bool inside = true;
+            for (std::size_t d = 0; d < rank; ++d) {
+              idx[d] = origin[d] + x[d];
+              inside = inside && idx[d] < e[d];
+            }
+            if (!inside) continue;
+            if constexpr (rank == 2) visit_element_impl(a, f, idx[0], idx[1]);
+            else visit_element_impl(a, f, idx[0], idx[1], idx[2]);
+          }
+        }
+      }
+    }
+
+  // Calls f for every element of a in the given order: f(element, i, j) or
+  // f(element, i, j, k) if f accepts the indices, f(element) otherwise.
+  template<typename A, typename F>
+      requires Multi_array<A> && (std::remove_const_t<A>::order() == 2
+                                  || std::remove_const_t<A>::order() == 3)
+    constexpr void for_each(A& a, order o, F f)
+    {
+      switch (o) {
+        case order::row_major: for_each_row_major_impl(a, f); break;
+        case order::morton: for_each_morton_impl(a, f); break;
+        case order::hilbert: for_each_hilbert_impl(a, f); break;
+      }
+    }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_ORDER_H
@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Fork-join helpers shared by the text I/O, tiling and numeric kernels.
+
+#ifndef TB_MULTI_ARRAY_PARALLEL_H
+#define TB_MULTI_ARRAY_PARALLEL_H
+
+#include "multi_array.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace tb {
+
+  // Runs f(i) for i in [0, n), one thread per index, rethrowing the first
+  // exception after all threads have joined. name labels the tasks on the
+  // timeline.
+  template<typename F>
+    void parallel_for_impl(std::size_t n, F f, const char* name = "task")
+    {
+      auto task = [&](std::size_t i) {
+        TB_MULTI_ARRAY_SPAN("task", name, static_cast<std::int64_t>(i));
+        f(i);
+      };
+      (void)name;
+      if (n <= 1) {
+        if (n == 1) task(std::size_t{0});
+        return;
+      }
+      std::vector<std::exception_ptr> errors(n);
+      std::vector<std::thread> threads;
+      threads.reserve(n - 1);
+      for (std::size_t i = 1; i < n; ++i)
+        threads.emplace_back([&, i] {
+          try { task(i); } catch (...) { errors[i] = std::current_exception(); }
+        });
+      try { task(std::size_t{0}); } catch (...) {
+        errors[0] = std::current_exception();
+      }
+      for (auto& t : threads) t.join();
+      for (auto& e : errors) if (e) std::rethrow_exception(e);
+    }
+
+  // Number of threads to use when the caller asks for n; 0 means one per
+  // hardware thread.
+  inline std::size_t thread_count_impl(std::size_t n) noexcept
+  { return n ? n : std::max(1u, std::thread::hardware_concurrency()); }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_PARALLEL_H
@@ -0,0 +1,206 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Strided traversal with software prefetching. Hardware prefetchers track
+// sequential and short-stride streams but give up on strides of a page or
+// more, so walks down the columns of a large row-major array stall on every
+// element. These walks prefetch a number of elements ahead that depends on
+// the stride and is tuned per machine (see multi_array_tune.h).
+
+#ifndef TB_MULTI_ARRAY_PREFETCH_H
+#define TB_MULTI_ARRAY_PREFETCH_H
+
+#include "multi_array.h"
+#include "multi_array_cache.h"
+#include "multi_array_tune.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+
+namespace tb {
+
+  // Strides below this many bytes are left to the hardware prefetcher.
+  inline constexpr std::size_t prefetch_min_stride = 64;
+  // Strides of at least this many bytes touch a new page on every step.
+  inline constexpr std::size_t prefetch_far_stride = 4096;
+  // Size of the matrix the prefetch tuners walk.
+  inline constexpr std::size_t prefetch_tuning_bytes = std::size_t{32} << 20;
+
+  // Whether a walk reads the elements it visits or also writes them. A
+  // prefetch for writing fetches the line exclusive, which costs the other
+  // cores that share it, so walks prefetch for reading unless told otherwise.
+  enum class prefetch_intent { read, write };
+
+  // Hints that *p is about to be accessed as Intent says.
+  template<prefetch_intent Intent = prefetch_intent::read>
+    inline void prefetch_impl(const void* p) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+      __builtin_prefetch(p, Intent == prefetch_intent::write ? 1 : 0, 3);
+#else
+      (void)p;
+#endif
+    }
+
+  // Visits n elements stride apart, prefetching distance elements ahead.
+  template<prefetch_intent Intent, typename T, typename F>
+    void strided_walk_impl(T* first, std::size_t n, std::ptrdiff_t stride,
+                           std::size_t distance, F& f)
+    {
+      std::size_t i = 0;
+      if (distance > 0 && distance < n) {
+        T* ahead = first + static_cast<std::ptrdiff_t>(distance) * stride;
+        for (; i + distance < n; ++i, first += stride, ahead += stride) {
+          prefetch_impl<Intent>(ahead);
+          f(*first);
+        }
+      }
+      for (; i < n; ++i, first += stride) f(*first);
+    }
+
+  // Row-major float matrix of 32 MiB for the prefetch tuners.
+  inline float* prefetch_tuning_data_impl()
+  {
+    static const std::unique_ptr<float[]> data(new float[prefetch_tuning_bytes / sizeof(float)]());
+    return data.get();
+  }
+
+  // Walks columns of the tuning matrix with cols columns.
+  inline void prefetch_tuning_walk_impl(std::size_t cols, std::size_t distance)
+  {
+    const float* data = prefetch_tuning_data_impl();
+    const std::size_t rows = prefetch_tuning_bytes / sizeof(float) / cols;
+    const std::size_t line = cache_line / sizeof(float);
+    volatile float sink = 0;
+    float sum = 0;
+    auto add = [&](const float& x) { sum += x; };
+    // One column per cache line, so that every access misses.
+    for (std::size_t j = 0; j < std::min<std::size_t>(cols, 64 * line); j += line)
+      strided_walk_impl<prefetch_intent::read>(data + j, rows, static_cast<std::ptrdiff_t>(cols), distance, add);
+    sink = sum;
+    (void)sink;
+  }
+
+  // Every walk starts with the matrix evicted from the caches, so that the
+  // candidates are timed against memory even when the matrix would fit in
+  // the last-level cache.
+  inline long tune_prefetch_impl(std::size_t stride_bytes)
+  {
+    return fastest_candidate({ 0, 2, 4, 8, 16, 32, 64 }, [stride_bytes](long d) {
+      prefetch_tuning_walk_impl(stride_bytes / sizeof(float), d);
+    }, [](long) {
+      cache_flush_impl(prefetch_tuning_data_impl(), prefetch_tuning_bytes);
+    });
+  }
+
+  inline const bool prefetch_tuners_registered_impl
+    = register_tuner("prefetch.near", [] { return tune_prefetch_impl(1024); })
+      && register_tuner("prefetch.far", [] { return tune_prefetch_impl(32768); });
+
+  // Number of elements to prefetch ahead on a walk with the given stride in
+  // bytes; 0 for strides the hardware prefetcher handles.
+  inline std::size_t prefetch_distance(std::size_t stride_bytes)
+  {
+    if (stride_bytes < prefetch_min_stride) return 0;
+    if (stride_bytes < prefetch_far_stride) {
+      static const long near = tuned_value("prefetch.near", 8);
+      return near;
+    }
+    static const long far = tuned_value("prefetch.far", 16);
+    return far;
+  }
+
+  // Calls f(x) for the n elements first[0], first[stride], ...,
+  // prefetching distance elements ahead (by default tuned to the stride).
+  // Walks whose f writes the elements pass prefetch_intent::write.
+  template<prefetch_intent Intent = prefetch_intent::read, typename T, typename F>
+    void for_each_strided(T* first, std::size_t n, std::ptrdiff_t stride, F f,
+                          std::size_t distance)
+    { strided_walk_impl<Intent>(first, n, stride, distance, f); }
+
+  template<prefetch_intent Intent = prefetch_intent::read, typename T, typename F>
+    void for_each_strided(T* first, std::size_t n, std::ptrdiff_t stride, F f)
+    {
+      const std::size_t bytes = static_cast<std::size_t>(stride < 0 ? -stride : stride) * sizeof(T);
+      strided_walk_impl<Intent>(first, n, stride, prefetch_distance(bytes), f);
+    }
+
+  // Calls f(x) for each element of column j of a rank-2 array, top down.
+  template<prefetch_intent Intent = prefetch_intent::read, typename A, typename F>
+      requires Multi_array<A> && (std::remove_const_t<A>::order() == 2)
+    void for_each_in_column(A& a, std::size_t j, F f)
+    {
+      constexpr auto e = multi_array_extents_v<std::remove_const_t<A>>;
+      assert(j < e[1]);
+      for_each_strided<Intent>(a.data() + j, e[0], e[1], f);
+    }
+
+  // Visits a rank-2 array column by column, as if it were transposed:
+  // f(x, i, j) if f accepts the indices, f(x) otherwise.
+  template<prefetch_intent Intent = prefetch_intent::read, typename A, typename F>
+      requires Multi_array<A> && (std::remove_const_t<A>::order() == 2)
+    void for_each_column_major(A& a, F f)
+    {
+      constexpr auto e = multi_array_extents_v<std::remove_const_t<A>>;
+      const std::size_t distance = prefetch_distance(e[1] * sizeof(*a.data()));
+      auto* first = a.data();
+      for (std::size_t j = 0; j < e[1]; ++j) {
+        std::size_t i = 0;
+        auto visit = [&](auto& x) {
+          if constexpr (std::is_invocable_v<F&, decltype(x), std::size_t, std::size_t>)
+            f(x, i++, j);
+          else
+            f(x);
+        };
+        strided_walk_impl<Intent>(first + j, e[0], e[1], distance, visit);
+      }
+    }
+
+  // Copies the elements of a at the given row-major offsets to out,
+  // prefetching ahead. Returns the end of the output.
+  template<typename A, typename OutputIt>
+      requires Multi_array<A>
+    OutputIt gather(const A& a, std::span<const std::size_t> offsets, OutputIt out)
+    {
+      const auto* data = a.data();
+      const std::size_t n = offsets.size();
+      const std::size_t distance = prefetch_distance(prefetch_far_stride);
+      std::size_t k = 0;
+      if (distance > 0)
+        for (; k + distance < n; ++k) {
+          assert(offsets[k] < A::total_size());
+          prefetch_impl(data + offsets[k + distance]);
+          *out++ = data[offsets[k]];
+        }
+      for (; k < n; ++k) {
+        assert(offsets[k] < A::total_size());
+        *out++ = data[offsets[k]];
+      }
+      return out;
+    }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_PREFETCH_H
@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Streaming copy, fill and swap for arrays larger than the last-level
+// cache. Above stream_threshold() the data is written with non-temporal
+// stores, which bypass the cache instead of evicting the working set of
+// every other thread, and split between threads to reach full memory write
+// bandwidth. Smaller arrays, and arrays of types that are not trivially
+// copyable, take the ordinary path. multi_array::fill() and swap() stream
+// above the same threshold, on the calling thread.
+
+#ifndef TB_MULTI_ARRAY_STREAM_H
+#define TB_MULTI_ARRAY_STREAM_H
+
+#include "multi_array.h"
+#include "multi_array_nontemporal.h"
+#include "multi_array_parallel.h"
+#include "multi_array_tune.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+namespace tb {
+
+  // Smallest share of a streaming operation worth a thread of its own, by
+  // default; stream_chunk_size() is the value tuned for this machine.
+  inline constexpr std::size_t stream_min_chunk = std::size_t{4} << 20;
+
+  inline std::size_t stream_chunk_size()
+  {
+    static const long chunk = tuned_value("stream.min_chunk", stream_min_chunk);
+    return static_cast<std::size_t>(std::max(1l, chunk));
+  }
+
+  // Calls f(first, count) on pieces of [0, n) elements of the given size,
+  // in parallel when there is enough work. Pieces start on multiples of 64
+  // elements, so that they start on cache line boundaries relative to each
+  // other. Each piece holds at least min_chunk bytes.
+  template<typename F>
+    void stream_for_impl(std::size_t n, std::size_t size, std::size_t threads,
+                         F f, const char* name,
+                         std::size_t min_chunk = stream_chunk_size())
+    {
+      const std::size_t parts = std::clamp<std::size_t>(n * size / min_chunk, 1,
+                                                        thread_count_impl(threads));
+      if (parts == 1) return f(std::size_t{0}, n);
+      parallel_for_impl(parts, [&](std::size_t t) {
+        const std::size_t first = n * t / parts / 64 * 64;
+        const std::size_t last = t + 1 == parts ? n : n * (t + 1) / parts / 64 * 64;
+        f(first, last - first);
+      }, name);
+    }
+
+  // Smallest piece size at which streaming a copy on two threads beats
+  // one; the largest candidate if it never does.
+  inline long tune_stream_min_chunk_impl()
+  {
+    const long candidates[] = { 1l << 20, 1l << 22, 1l << 24 };
+    if (std::thread::hardware_concurrency() < 2) return candidates[2];
+    const std::size_t bytes = 2 * candidates[2];
+    const std::unique_ptr<char[]> src(new char[bytes]()), dst(new char[bytes]);
+    for (long c : candidates) {
+      const long best = fastest_candidate({ 1, 2 }, [&](long t) {
+        stream_for_impl(2 * c, 1, t, [&](std::size_t first, std::size_t count) {
+          stream_copy_bytes_impl(dst.get() + first, src.get() + first, count);
+        }, "stream_tune", c);
+      }, 5);
+      if (best == 2) return c;
+    }
+    return candidates[2];
+  }
+
+  inline const bool stream_tuners_registered_impl
+    = register_tuner("stream.min_chunk", tune_stream_min_chunk_impl);
+
+  // Copies src to dst. threads bounds the number of threads (0: one per
+  // hardware thread).
+  template<Multi_array A>
+    void stream_copy(A& dst, const A& src, std::size_t threads = 0)
+    {
+      using T = typename A::element_type;
+      constexpr std::size_t bytes = A::total_size() * sizeof(T);
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        if (bytes >= stream_threshold() && &dst != &src) {
+          TB_MULTI_ARRAY_COPIED_AS(A, assign);
+          TB_MULTI_ARRAY_TIMED(copy);
+          TB_MULTI_ARRAY_SPAN("memory", "stream_copy", static_cast<std::int64_t>(bytes));
+          T* d = dst.data();
+          const T* s = src.data();
+          stream_for_impl(A::total_size(), sizeof(T), threads, [&](std::size_t first, std::size_t n) {
+            stream_copy_bytes_impl(reinterpret_cast<char*>(d + first),
+                                   reinterpret_cast<const char*>(s + first), n * sizeof(T));
+          }, "stream_copy");
+          return;
+        }
+      }
+      dst = src;
+    }
+
+  // Assigns value to every element of a.
+  template<Multi_array A>
+    void stream_fill(A& a, const typename A::element_type& value, std::size_t threads = 0)
+    {
+      using T = typename A::element_type;
+      constexpr std::size_t bytes = A::total_size() * sizeof(T);
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        if (bytes >= stream_threshold()) {
+          TB_MULTI_ARRAY_TIMED(fill);
+          TB_MULTI_ARRAY_SPAN("memory", "stream_fill", static_cast<std::int64_t>(bytes));
+          const T v = value;
+          T* d = a.data();
+          stream_for_impl(A::total_size(), sizeof(T), threads, [&](std::size_t first, std::size_t n) {
+            stream_fill_impl(d + first, n, v);
+          }, "stream_fill");
+          return;
+        }
+      }
+      a.fill(value);
+    }
+
+  // Exchanges the elements of a and b.
+  template<Multi_array A>
+    void stream_swap(A& a, A& b, std::size_t threads = 0)
+    {
+      using T = typename A::element_type;
+      constexpr std::size_t bytes = A::total_size() * sizeof(T);
+      if constexpr (is_trivially_relocatable_v<T>) {
+        if (bytes >= stream_threshold() && &a != &b) {
+          TB_MULTI_ARRAY_COPIED_AS(A, swap);
+          TB_MULTI_ARRAY_TIMED(swap);
+          TB_MULTI_ARRAY_SPAN("memory", "stream_swap", static_cast<std::int64_t>(bytes));
+          T* x = a.data();
+          T* y = b.data();
+          stream_for_impl(A::total_size(), sizeof(T), threads, [&](std::size_t first, std::size_t n) {
+            stream_swap_bytes_impl(reinterpret_cast<char*>(x + first),
+                                   reinterpret_cast<char*>(y + first), n * sizeof(T));
+          }, "stream_swap");
+          return;
+        }
+      }
+      a.swap(b);
+    }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_STREAM_H
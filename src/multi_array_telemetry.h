@@ -0,0 +1,378 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Latency telemetry, enabled by defining TB_MULTI_ARRAY_TELEMETRY before
+// including multi_array.h. fill, copies, swap, the file and text
+// functions and the linear algebra kernels record their wall time into per-thread log-linear histograms.
+// Recording touches only the calling thread's counters; readers merge the
+// histograms of every thread and export them as Prometheus text or JSON.
+
+#ifndef TB_MULTI_ARRAY_TELEMETRY_H
+#define TB_MULTI_ARRAY_TELEMETRY_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace tb {
+
+  enum class telemetry_op {
+    fill, copy, swap, load_text, to_string, save_binary, load_binary,
+    save_arrow, load_arrow, dot, axpy, norm, matvec, lu_factor, lu_solve,
+    cholesky, cholesky_solve, count
+  };
+
+  inline constexpr const char* telemetry_op_names[] = {
+    "fill", "copy", "swap", "load_text", "to_string", "save_binary",
+    "load_binary", "save_arrow", "load_arrow", "dot", "axpy", "norm", "matvec",
+    "lu_factor", "lu_solve", "cholesky", "cholesky_solve"
+  };
+  static_assert(std::size(telemetry_op_names)
+                == static_cast<std::size_t>(telemetry_op::count));
+
+  // Log-linear bucketing of nanosecond latencies: values below 16 have
+  // their own bucket, larger values are split into 16 buckets per power of
+  // two, so every bucket is within 6.25% of its values.
+  struct latency_buckets {
+    static constexpr unsigned sub_bits = 4;
+    static constexpr std::uint64_t sub_count = 1u << sub_bits;
+    static constexpr std::size_t count = sub_count * (64 - sub_bits + 1);
+
+    static constexpr std::size_t index(std::uint64_t ns) noexcept
+    {
+      if (ns < sub_count) return ns;
+      const unsigned shift = std::bit_width(ns) - 1 - sub_bits;
+      return sub_count * (shift + 1) + ((ns >> shift) - sub_count);
+    }
+
+    static constexpr std::uint64_t lower(std::size_t i) noexcept
+    {
+      if (i < sub_count) return i;
+      const std::size_t shift = i / sub_count - 1;
+      return (sub_count + i % sub_count) << shift;
+    }
+
+    // Largest value of bucket i.
+    static constexpr std::uint64_t upper(std::size_t i) noexcept
+    { return i + 1 < count ? lower(i + 1) - 1 : UINT64_MAX; }
+  };
+
+  static_assert(latency_buckets::index(15) == 15);
+  static_assert(latency_buckets::index(16) == 16);
+  static_assert(latency_buckets::lower(latency_buckets::index(1000)) <= 1000);
+  static_assert(latency_buckets::upper(latency_buckets::index(1000)) >= 1000);
+  static_assert(latency_buckets::index(UINT64_MAX) == latency_buckets::count - 1);
+
+  // Merged latency distribution of one operation.
+  struct latency_histogram {
+    telemetry_op op{};
+    std::vector<std::uint64_t> counts = std::vector<std::uint64_t>(latency_buckets::count);
+    std::uint64_t count = 0;
+    std::uint64_t sum_ns = 0;
+    std::uint64_t max_ns = 0;
+
+    const char* name() const noexcept
+    { return telemetry_op_names[static_cast<std::size_t>(op)]; }
+
+    // Upper bound of the bucket holding the q-quantile, capped at max_ns.
+    std::uint64_t quantile(double q) const noexcept
+    {
+      if (count == 0) return 0;
+      const auto rank = static_cast<std::uint64_t>(q * (count - 1)) + 1;
+      std::uint64_t seen = 0;
+      for (std::size_t i = 0; i < counts.size(); ++i)
+        if ((seen += counts[i]) >= rank)
+          return std::min(latency_buckets::upper(i), max_ns);
+      return max_ns;
+    }
+  };
+
+  // Counters written only by their owning thread.
+  struct telemetry_thread_impl {
+    struct op_counters {
+      std::atomic<std::uint64_t> counts[latency_buckets::count] = {};
+      std::atomic<std::uint64_t> count{0};
+      std::atomic<std::uint64_t> sum_ns{0};
+      std::atomic<std::uint64_t> max_ns{0};
+    };
+    op_counters ops[static_cast<std::size_t>(telemetry_op::count)];
+
+    // Single writer, so a relaxed load and store replace a locked add.
+    static void bump(std::atomic<std::uint64_t>& a, std::uint64_t n) noexcept
+    { a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+    void record(telemetry_op op, std::uint64_t ns) noexcept
+    {
+      auto& c = ops[static_cast<std::size_t>(op)];
+      bump(c.counts[latency_buckets::index(ns)], 1);
+      bump(c.count, 1);
+      bump(c.sum_ns, ns);
+      if (ns > c.max_ns.load(std::memory_order_relaxed))
+        c.max_ns.store(ns, std::memory_order_relaxed);
+    }
+
+    void clear() noexcept
+    {
+      for (auto& c : ops) {
+        for (auto& b : c.counts) b.store(0, std::memory_order_relaxed);
+        c.count = 0;
+        c.sum_ns = 0;
+        c.max_ns = 0;
+      }
+    }
+  };
+
+  // Owns the counters of every thread that ever recorded; they outlive
+  // their threads so that nothing recorded is lost.
+  struct telemetry_registry_impl {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<telemetry_thread_impl>> threads;
+    std::vector<telemetry_thread_impl*> free;  // of exited threads
+
+    static telemetry_registry_impl& get()
+    {
+      static telemetry_registry_impl instance;
+      return instance;
+    }
+  };
+
+  // Returns a thread's counters to the registry when the thread exits.
+  struct telemetry_holder_impl {
+    telemetry_thread_impl* counters = nullptr;
+
+    ~telemetry_holder_impl()
+    {
+      if (!counters) return;
+      auto& registry = telemetry_registry_impl::get();
+      std::lock_guard lock(registry.mutex);
+      registry.free.push_back(counters);
+    }
+  };
+
+  // The calling thread's counters, taken on first use. Counters of exited
+  // threads are taken over with what they hold, so snapshots stay
+  // cumulative, and spawning workers repeatedly needs no more counters
+  // than were ever recording at once.
+  inline telemetry_thread_impl& telemetry_thread()
+  {
+    thread_local telemetry_holder_impl holder;
+    if (!holder.counters) {
+      auto& registry = telemetry_registry_impl::get();
+      std::lock_guard lock(registry.mutex);
+      if (!registry.free.empty()) {
+        holder.counters = registry.free.back();
+        registry.free.pop_back();
+      } else {
+        registry.threads.push_back(std::make_unique<telemetry_thread_impl>());
+        holder.counters = registry.threads.back().get();
+      }
+    }
+    return *holder.counters;
+  }
+
+  inline int& telemetry_depth_impl() noexcept
+  {
+    thread_local int depth = 0;
+    return depth;
+  }
+
+  // Times its own lifetime as one op. Scopes nested inside another scope on
+  // the same thread (a rank-N copy made of sub-array copies, an array built
+  // by a loader) are not recorded separately.
+  class telemetry_scope {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    constexpr explicit telemetry_scope(telemetry_op op) noexcept : op_(op)
+    {
+      if (std::is_constant_evaluated()) return;
+      if (telemetry_depth_impl()++ == 0) start_ = clock::now().time_since_epoch().count();
+    }
+
+    // Records nothing, only hides the ops nested in it.
+    constexpr telemetry_scope() noexcept : op_(telemetry_op::count)
+    { if (!std::is_constant_evaluated()) ++telemetry_depth_impl(); }
+
+    telemetry_scope(const telemetry_scope&) = delete;
+    telemetry_scope& operator=(const telemetry_scope&) = delete;
+
+    constexpr ~telemetry_scope()
+    {
+      if (std::is_constant_evaluated()) return;
+      if (--telemetry_depth_impl() != 0 || op_ == telemetry_op::count) return;
+      const auto stop = clock::now().time_since_epoch().count();
+      const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        clock::duration(stop - start_)).count();
+      try {
+        telemetry_thread().record(op_, static_cast<std::uint64_t>(std::max<decltype(ns)>(ns, 0)));
+      } catch (...) {}
+    }
+
+  private:
+    telemetry_op op_;
+    clock::rep start_ = 0;
+  };
+
+  // Merges the histograms of all threads, one entry per operation.
+  inline std::vector<latency_histogram> telemetry_snapshot()
+  {
+    std::vector<latency_histogram> result(static_cast<std::size_t>(telemetry_op::count));
+    for (std::size_t op = 0; op < result.size(); ++op)
+      result[op].op = static_cast<telemetry_op>(op);
+    auto& registry = telemetry_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    for (const auto& t : registry.threads) {
+      for (std::size_t op = 0; op < result.size(); ++op) {
+        const auto& c = t->ops[op];
+        auto& h = result[op];
+        for (std::size_t i = 0; i < latency_buckets::count; ++i)
+          h.counts[i] += c.counts[i].load(std::memory_order_relaxed);
+        h.count += c.count.load(std::memory_order_relaxed);
+        h.sum_ns += c.sum_ns.load(std::memory_order_relaxed);
+        h.max_ns = std::max(h.max_ns, c.max_ns.load(std::memory_order_relaxed));
+      }
+    }
+    return result;
+  }
+
+  // Clears all histograms. Records made concurrently may be lost.
+  inline void telemetry_reset()
+  {
+    auto& registry = telemetry_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    for (const auto& t : registry.threads) t->clear();
+  }
+
+  // Bucket bounds exported to Prometheus: 2^k - 1 ns for k in this range,
+  // about 15 ns to 69 s. Each is the upper end of a latency bucket, so the
+  // cumulative counts are exact.
+  inline constexpr unsigned prometheus_min_log2 = 4;
+  inline constexpr unsigned prometheus_max_log2 = 36;
+
+  static_assert(latency_buckets::upper(latency_buckets::index(1u << 10) - 1)
+                == (1u << 10) - 1);
+
+  // Prometheus text exposition: one histogram, labelled by op, in seconds.
+  // Every op gets the same cumulative buckets, ending in +Inf.
+  inline std::string telemetry_prometheus()
+  {
+    std::string out =
+      "# HELP multi_array_op_duration_seconds Latency of multi_array operations.\n"
+      "# TYPE multi_array_op_duration_seconds histogram\n";
+    char line[512];
+    for (const auto& h : telemetry_snapshot()) {
+      std::uint64_t cumulative = 0;
+      std::size_t i = 0;
+      for (unsigned k = prometheus_min_log2; k <= prometheus_max_log2; ++k) {
+        const std::uint64_t bound = (std::uint64_t{1} << k) - 1;
+        for (; i < h.counts.size() && latency_buckets::upper(i) <= bound; ++i)
+          cumulative += h.counts[i];
+        std::snprintf(line, sizeof line,
+                      "multi_array_op_duration_seconds_bucket{op=\"%s\",le=\"%.12g\"} %llu\n",
+                      h.name(), bound * 1e-9, (unsigned long long)cumulative);
+        out += line;
+      }
+      std::snprintf(line, sizeof line,
+                    "multi_array_op_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n"
+                    "multi_array_op_duration_seconds_sum{op=\"%s\"} %.9g\n"
+                    "multi_array_op_duration_seconds_count{op=\"%s\"} %llu\n",
+                    h.name(), (unsigned long long)h.count, h.name(),
+                    h.sum_ns * 1e-9, h.name(), (unsigned long long)h.count);
+      out += line;
+    }
+    return out;
+  }
+
+  // JSON object keyed by op with count, sum, max, quantiles and the
+  // non-empty buckets as [lower_ns, upper_ns, count] triples.
+  inline std::string telemetry_json()
+  {
+    std::string out = "{";
+    char buf[256];
+    bool first_op = true;
+    for (const auto& h : telemetry_snapshot()) {
+      if (h.count == 0) continue;
+      std::snprintf(buf, sizeof buf,
+                    "%s\n  \"%s\": {\"count\": %llu, \"sum_ns\": %llu, \"max_ns\": %llu, "
+                    "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, "
+                    "\"p999_ns\": %llu, \"buckets\": [",
+                    first_op ? "" : ",", h.name(), (unsigned long long)h.count,
+                    (unsigned long long)h.sum_ns, (unsigned long long)h.max_ns,
+                    (unsigned long long)h.quantile(0.5),
+                    (unsigned long long)h.quantile(0.9),
+                    (unsigned long long)h.quantile(0.99),
+                    (unsigned long long)h.quantile(0.999));
+      out += buf;
+      first_op = false;
+      bool first_bucket = true;
+      for (std::size_t i = 0; i < h.counts.size(); ++i) {
+        if (h.counts[i] == 0) continue;
+        std::snprintf(buf, sizeof buf, "%s[%llu, %llu, %llu]",
+                      first_bucket ? "" : ", ",
+                      (unsigned long long)latency_buckets::lower(i),
+                      (unsigned long long)latency_buckets::upper(i),
+                      (unsigned long long)h.counts[i]);
+        out += buf;
+        first_bucket = false;
+      }
+      out += "]}";
+    }
+    return out + "\n}\n";
+  }
+
+  enum class telemetry_format { prometheus, json };
+
+  // Writes the current telemetry to path, replacing it atomically so that
+  // a scraper never sees a partial file. Throws std::runtime_error on
+  // failure.
+  inline void save_telemetry(const std::filesystem::path& path,
+                             telemetry_format format = telemetry_format::prometheus)
+  {
+    const std::string text = format == telemetry_format::json
+                             ? telemetry_json() : telemetry_prometheus();
+    auto temporary = path;
+    temporary += ".tmp";
+    std::FILE* f = std::fopen(temporary.string().c_str(), "wb");
+    if (!f)
+      throw std::runtime_error("multi_array: cannot open " + temporary.string());
+    const bool written = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (std::fclose(f) != 0 || !written)
+      throw std::runtime_error("multi_array: cannot write " + temporary.string());
+    std::error_code ec;
+    std::filesystem::rename(temporary, path, ec);
+    if (ec)
+      throw std::runtime_error("multi_array: cannot write " + path.string());
+  }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_TELEMETRY_H
@@ -0,0 +1,484 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef TB_MULTI_ARRAY_TEXT_H
+#define TB_MULTI_ARRAY_TEXT_H
+
+#include "multi_array.h"
+#include "multi_array_parallel.h"
+#include "multi_array_tune.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __has_include(<format>)
+#  include <format>
+#endif
+
+#if __has_include(<sys/mman.h>)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#  define TB_MULTI_ARRAY_HAS_MMAP 1
+#endif
+
+namespace tb {
+
+  // Read-only view of a whole file. Memory-mapped where the platform allows
+  // it, otherwise read into a buffer.
+  class mapped_file_impl {
+  public:
+    explicit mapped_file_impl(const std::filesystem::path& path)
+    {
+#ifdef TB_MULTI_ARRAY_HAS_MMAP
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error("multi_array: cannot open " + path.string());
+      struct stat st;
+      if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("multi_array: cannot stat " + path.string());
+      }
+      size_ = static_cast<std::size_t>(st.st_size);
+      if (size_ > 0) {
+        void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          ::madvise(p, size_, MADV_SEQUENTIAL);
+          data_ = static_cast<const char*>(p);
+          mapped_ = true;
+        }
+      }
+      ::close(fd);
+      if (mapped_ || size_ == 0) return;
+#endif
+      std::FILE* f = std::fopen(path.string().c_str(), "rb");
+      if (!f)
+        throw std::runtime_error("multi_array: cannot open " + path.string());
+      char chunk[1 << 16];
+      for (std::size_t n; (n = std::fread(chunk, 1, sizeof chunk, f)) > 0; )
+        buffer_.append(chunk, n);
+      std::fclose(f);
+      data_ = buffer_.data();
+      size_ = buffer_.size();
+    }
+
+    mapped_file_impl(const mapped_file_impl&) = delete;
+    mapped_file_impl& operator=(const mapped_file_impl&) = delete;
+
+    ~mapped_file_impl()
+    {
+#ifdef TB_MULTI_ARRAY_HAS_MMAP
+      if (mapped_) ::munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+
+    const char* begin() const noexcept { return data_; }
+    const char* end() const noexcept { return data_ + size_; }
+    std::size_t size() const noexcept { return size_; }
+
+  private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+    bool mapped_ = false;
+    std::string buffer_;
+  };
+
+  // Blank characters that may surround a field, besides the delimiter.
+  constexpr bool is_text_blank_impl(char c) noexcept
+  { return c == ' ' || c == '\t' || c == '\r'; }
+
+  // Returns the end of the line starting at first (the '\n' or last).
+  inline const char* text_line_end_impl(const char* first, const char* last)
+  {
+    auto p = static_cast<const char*>(std::memchr(first, '\n', last - first));
+    return p ? p : last;
+  }
+
+  inline bool text_line_blank_impl(const char* first, const char* last)
+  {
+    for (; first != last; ++first)
+      if (!is_text_blank_impl(*first)) return false;
+    return true;
+  }
+
+  // Parses the fields of one line into out. Returns the number of fields,
+  // writing at most limit values.
+  template<typename T>
+    std::size_t
+    parse_text_line_impl(const char* first, const char* last, char delim,
+                         T* out, std::size_t limit)
+    {
+      std::size_t count = 0;
+      while (first != last) {
+        while (first != last && is_text_blank_impl(*first)) ++first;
+        if (first == last) break;
+        if (count > 0) {
+          if (*first != delim && !is_text_blank_impl(delim))
+            throw std::runtime_error("multi_array: expected delimiter");
+          if (*first == delim) ++first;
+          while (first != last && is_text_blank_impl(*first)) ++first;
+        }
+        T value;
+        auto [p, ec] = std::from_chars(first, last, value);
+        if (ec != std::errc())
+          throw std::runtime_error("multi_array: malformed number");
+        if (count < limit) out[count] = value;
+        ++count;
+        first = p;
+      }
+      return count;
+    }
+
+  // Splits [first, last) into at most n pieces that start on line boundaries.
+  inline std::vector<const char*>
+  split_text_lines_impl(const char* first, const char* last, std::size_t n)
+  {
+    std::vector<const char*> bounds{first};
+    const std::size_t step = (last - first) / n;
+    for (std::size_t i = 1; i < n; ++i) {
+      const char* p = std::max(bounds.back(), first + i * step);
+      p = text_line_end_impl(p, last);
+      if (p != last) ++p;
+      if (p != bounds.back()) bounds.push_back(p);
+    }
+    if (bounds.back() != last) bounds.push_back(last);
+    return bounds;
+  }
+
+  // Number of worker threads for processing a buffer of the given size, given
+  // the smallest slice worth a thread of its own.
+  inline std::size_t
+  text_thread_count_impl(std::size_t bytes, std::size_t min_chunk,
+                         std::size_t max_threads)
+  { return std::max<std::size_t>(1, std::min(max_threads, bytes / min_chunk)); }
+
+  // As above, with the machine's tuned parameters (see multi_array_tune.h),
+  // looked up on first use.
+  inline std::size_t text_thread_count_impl(std::size_t bytes)
+  {
+    static const long min_chunk = tuned_value("text.min_chunk", 1l << 20);
+    static const long max_threads = tuned_value(
+      "text.threads", std::max(1u, std::thread::hardware_concurrency()));
+    return text_thread_count_impl(bytes, std::max(1l, min_chunk),
+                                  std::max(1l, max_threads));
+  }
+
+  // Parses rows of exactly cols fields from the text into out, which must
+  // have room for rows * cols values. When rows is 0 any number of rows is
+  // accepted and out is resized to fit. Returns the number of rows read.
+  // threads overrides the tuned thread count when it is not 0.
+  template<typename T>
+    std::size_t
+    parse_text_impl(const char* first, const char* last, char delim,
+                    std::size_t cols, std::size_t rows, std::vector<T>* grow,
+                    T* out, std::size_t threads = 0)
+    {
+      auto bounds = split_text_lines_impl(first, last, threads ? threads
+                                          : text_thread_count_impl(last - first));
+      const std::size_t chunks = bounds.size() - 1;
+
+      // First pass: count the non-blank lines in every chunk.
+      std::vector<std::size_t> offset(chunks + 1, 0);
+      parallel_for_impl(chunks, [&](std::size_t c) {
+        std::size_t n = 0;
+        for (const char* p = bounds[c]; p != bounds[c + 1]; ) {
+          const char* e = text_line_end_impl(p, bounds[c + 1]);
+          if (!text_line_blank_impl(p, e)) ++n;
+          p = e == bounds[c + 1] ? e : e + 1;
+        }
+        offset[c + 1] = n;
+      }, "count_lines");
+      for (std::size_t c = 0; c < chunks; ++c) offset[c + 1] += offset[c];
+
+      if (rows == 0) {
+        grow->resize(offset[chunks] * cols);
+        out = grow->data();
+      } else if (offset[chunks] != rows) {
+        throw std::runtime_error("multi_array: wrong number of rows");
+      }
+
+      // Second pass: parse each chunk straight into its rows.
+      parallel_for_impl(chunks, [&](std::size_t c) {
+        T* row = out + offset[c] * cols;
+        for (const char* p = bounds[c]; p != bounds[c + 1]; ) {
+          const char* e = text_line_end_impl(p, bounds[c + 1]);
+          if (!text_line_blank_impl(p, e)) {
+            if (parse_text_line_impl(p, e, delim, row, cols) != cols)
+              throw std::runtime_error("multi_array: wrong number of columns");
+            row += cols;
+          }
+          p = e == bounds[c + 1] ? e : e + 1;
+        }
+      }, "parse_lines");
+      return offset[chunks];
+    }
+
+  // Synthetic input for the text tuners: rows of 16 doubles.
+  inline const std::string& text_tuning_input_impl()
+  {
+    static const std::string text = [] {
+      std::string s;
+      for (int row = 0; s.size() < (std::size_t{8} << 20); ++row)
+        for (int col = 0; col < 16; ++col)
+          s += std::to_string(row * 0.25 + col) + (col == 15 ? '\n' : ',');
+      return s;
+    }();
+    return text;
+  }
+
+  // Parses about bytes bytes of the tuning input with the given threads.
+  inline void text_tuning_parse_impl(std::size_t bytes, std::size_t threads)
+  {
+    const std::string& text = text_tuning_input_impl();
+    const char* first = text.data();
+    const char* last = first + std::min(bytes, text.size());
+    while (last != text.data() + text.size() && last[-1] != '\n') ++last;
+    std::vector<double> values;
+    parse_text_impl<double>(first, last, ',', 16, 0, &values, nullptr, threads);
+  }
+
+  // Thread count that parses a large buffer fastest.
+  inline long tune_text_threads_impl()
+  {
+    std::vector<long> candidates;
+    const long hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (long t = 1; t < hardware; t *= 2) candidates.push_back(t);
+    candidates.push_back(hardware);
+    return fastest_candidate(candidates, [](long t) {
+      text_tuning_parse_impl(std::size_t{8} << 20, t);
+    });
+  }
+
+  // Smallest slice size at which splitting a buffer between two threads
+  // beats parsing it on one; the largest candidate if it never does.
+  inline long tune_text_min_chunk_impl()
+  {
+    const long candidates[] = { 1l << 16, 1l << 18, 1l << 20, 1l << 22 };
+    if (std::thread::hardware_concurrency() < 2) return candidates[3];
+    for (long c : candidates) {
+      const long best = fastest_candidate({ 1, 2 }, [c](long t) {
+        text_tuning_parse_impl(2 * c, t);
+      }, 5);
+      if (best == 2) return c;
+    }
+    return candidates[3];
+  }
+
+  inline const bool text_tuners_registered_impl
+    = register_tuner("text.threads", tune_text_threads_impl)
+      && register_tuner("text.min_chunk", tune_text_min_chunk_impl);
+
+  // Row-major table of values with a shape only known at run time.
+  template<typename T>
+    struct text_table {
+      std::vector<T> values;
+      std::size_t rows = 0;
+      std::size_t columns = 0;
+
+      T& operator()(std::size_t i, std::size_t j) noexcept
+      { return values[i * columns + j]; }
+      const T& operator()(std::size_t i, std::size_t j) const noexcept
+      { return values[i * columns + j]; }
+    };
+
+  // Loads delimited numeric text into a multi_array. Every line holds one
+  // row of the innermost dimension; outer dimensions are read in row-major
+  // order. Blank lines are skipped. Throws std::runtime_error on I/O errors,
+  // malformed numbers or a shape mismatch.
+  template<Multi_array A>
+    A load_text(const std::filesystem::path& path, char delim = ',')
+    {
+      TB_MULTI_ARRAY_TIMED(load_text);
+      TB_MULTI_ARRAY_SPAN("io", "load_text", -1);
+      using T = typename A::element_type;
+      constexpr std::size_t cols = innermost_extent_v<A>;
+      mapped_file_impl file(path);
+      A result;
+      parse_text_impl<T>(file.begin(), file.end(), delim, cols,
+                         A::total_size() / cols, nullptr, result.data());
+      return result;
+    }
+
+  // Loads delimited numeric text of any shape. The number of columns is
+  // taken from the first non-blank line and must be the same on every line.
+  template<typename T>
+      requires (!Multi_array<T>)
+    text_table<T> load_text(const std::filesystem::path& path, char delim = ',')
+    {
+      TB_MULTI_ARRAY_TIMED(load_text);
+      TB_MULTI_ARRAY_SPAN("io", "load_text", -1);
+      mapped_file_impl file(path);
+      text_table<T> result;
+      const char* first = file.begin();
+      const char* last = file.end();
+      while (first != last) {
+        const char* e = text_line_end_impl(first, last);
+        if (!text_line_blank_impl(first, e)) {
+          result.columns = parse_text_line_impl<T>(first, e, delim, nullptr, 0);
+          break;
+        }
+        first = e == last ? e : e + 1;
+      }
+      if (result.columns > 0)
+        result.rows = parse_text_impl<T>(first, last, delim, result.columns, 0,
+                                         &result.values, nullptr);
+      return result;
+    }
+
+  // Controls the layout of formatted multi_arrays. Arrays with more than
+  // threshold elements are summarized: every dimension longer than
+  // 2 * edge_items shows only its first and last edge_items entries.
+  struct format_options {
+    std::size_t threshold = 1000;
+    std::size_t edge_items = 3;
+  };
+
+  template<typename T>
+    concept Chars_convertible = requires(char* p, T v) { std::to_chars(p, p, v); };
+
+  template<typename T>
+    void format_element_impl(std::string& out, const T& value)
+    {
+      char buf[64];
+      auto [p, ec] = std::to_chars(buf, buf + sizeof buf, value);
+      out.append(buf, p);
+    }
+
+  template<typename T>
+    void format_separator_impl(std::string& out, std::size_t depth)
+    {
+      if constexpr (Multi_array<T>) {
+        out += ",\n";
+        out.append(depth + 1, ' ');
+      } else {
+        out += ", ";
+      }
+    }
+
+  // Formats the rows [first, last) of a without the enclosing brackets.
+  template<typename T, std::size_t M, std::size_t... N>
+    void format_rows_impl(std::string& out, const multi_array<T, M, N...>& a,
+                          std::size_t first, std::size_t last,
+                          std::size_t depth, std::size_t edge)
+    {
+      using V = typename multi_array<T, M, N...>::value_type;
+      const bool elide = edge > 0 && M > 2 * edge;
+      for (std::size_t i = first; i < last; ++i) {
+        if (i != first) format_separator_impl<V>(out, depth);
+        if (elide && i == edge) {
+          out += "...";
+          i = M - edge - 1;
+          continue;
+        }
+        if constexpr (Multi_array<V>) {
+          out += '[';
+          format_rows_impl(out, a[i], 0, V::size(), depth + 1, edge);
+          out += ']';
+        } else {
+          format_element_impl(out, a[i]);
+        }
+      }
+    }
+
+  // Returns the nested, bracketed text of a, e.g. "[[1, 2],\n [3, 4]]".
+  // Large arrays that are printed in full are formatted in parallel over
+  // their outermost dimension.
+  template<Chars_convertible T, std::size_t M, std::size_t... N>
+    std::string to_string(const multi_array<T, M, N...>& a,
+                          const format_options& options = {})
+    {
+      TB_MULTI_ARRAY_TIMED(to_string);
+      using V = typename multi_array<T, M, N...>::value_type;
+      constexpr std::size_t total = (M * ... * N);
+      TB_MULTI_ARRAY_SPAN("text", "to_string", static_cast<std::int64_t>(total));
+      const std::size_t edge = total > options.threshold ? options.edge_items : 0;
+      const std::size_t chunks = edge > 0 ? 1 : std::min<std::size_t>(
+          M, text_thread_count_impl(total * sizeof(T)));
+
+      std::vector<std::string> parts(chunks);
+      parallel_for_impl(chunks, [&](std::size_t c) {
+        const std::size_t first = M * c / chunks;
+        const std::size_t last = M * (c + 1) / chunks;
+        parts[c].reserve(edge > 0 ? 64 * options.edge_items * (sizeof...(N) + 1)
+                                  : (last - first) * (total / M) * 16);
+        format_rows_impl(parts[c], a, first, last, 0, edge);
+      }, "format_rows");
+
+      std::string result;
+      std::size_t length = 2;
+      for (auto& part : parts) length += part.size() + sizeof...(N) + 2;
+      result.reserve(length);
+      result += '[';
+      for (std::size_t c = 0; c < chunks; ++c) {
+        if (c > 0) format_separator_impl<V>(result, 0);
+        result += parts[c];
+      }
+      result += ']';
+      return result;
+    }
+
+  template<Chars_convertible T, std::size_t M, std::size_t... N>
+    std::ostream& operator<<(std::ostream& os, const multi_array<T, M, N...>& a)
+    {
+      const std::string text = to_string(a);
+      return os.write(text.data(), text.size());
+    }
+
+} // namespace tb
+
+#if defined(__cpp_lib_format)
+// std::format support. "{}" summarizes large arrays as to_string() does;
+// "{:f}" always prints every element.
+template<tb::Chars_convertible T, std::size_t M, std::size_t... N>
+  struct std::formatter<tb::multi_array<T, M, N...>, char> {
+    bool full = false;
+
+    constexpr auto parse(std::format_parse_context& ctx)
+    {
+      auto it = ctx.begin();
+      if (it != ctx.end() && *it == 'f') { full = true; ++it; }
+      if (it != ctx.end() && *it != '}')
+        throw std::format_error("invalid format spec for multi_array");
+      return it;
+    }
+
+    template<typename Context>
+      auto format(const tb::multi_array<T, M, N...>& a, Context& ctx) const
+      {
+        tb::format_options options;
+        if (full) options.threshold = static_cast<std::size_t>(-1);
+        const std::string text = tb::to_string(a, options);
+        return std::copy(text.begin(), text.end(), ctx.out());
+      }
+  };
+#endif
+
+#endif//TB_MULTI_ARRAY_TEXT_H
@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Tiled traversal of rank-2 multi_arrays. for_each_tile<TY, TX>(a, f) calls
+// f once per TY x TX tile with a multi_array_view of it; tiles along the
+// bottom and right edges are cut to the array, every other tile is full.
+// Each row of a view is contiguous, so inner loops over row(i) vectorize.
+
+#ifndef TB_MULTI_ARRAY_TILE_H
+#define TB_MULTI_ARRAY_TILE_H
+
+#include "multi_array.h"
+#include "multi_array_parallel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+namespace tb {
+
+  // Non-owning view of a rectangle of a row-major rank-2 array.
+  template<typename T>
+    class multi_array_view {
+    public:
+      using element_type = T;
+      using size_type    = std::size_t;
+
+      constexpr multi_array_view(T* first, size_type rows, size_type cols,
+                                 size_type stride, size_type row_offset = 0,
+                                 size_type col_offset = 0) noexcept
+        : first_(first), rows_(rows), cols_(cols), stride_(stride),
+          row_offset_(row_offset), col_offset_(col_offset) {}
+
+      constexpr size_type rows() const noexcept { return rows_; }
+      constexpr size_type cols() const noexcept { return cols_; }
+      constexpr size_type size() const noexcept { return rows_ * cols_; }
+      // Distance in elements between the starts of consecutive rows.
+      constexpr size_type stride() const noexcept { return stride_; }
+      // Position of element (0, 0) in the viewed array.
+      constexpr size_type row_offset() const noexcept { return row_offset_; }
+      constexpr size_type col_offset() const noexcept { return col_offset_; }
+
+      constexpr T* row(size_type i) const noexcept
+      {
+        assert(i < rows_);
+        return first_ + i * stride_;
+      }
+
+      constexpr T& operator()(size_type i, size_type j) const noexcept
+      {
+        assert(i < rows_ && j < cols_);
+        return first_[i * stride_ + j];
+      }
+
+      template<typename F>
+        constexpr void for_each(F f) const
+        {
+          for (size_type i = 0; i < rows_; ++i) {
+            T* r = row(i);
+            for (size_type j = 0; j < cols_; ++j) f(r[j]);
+          }
+        }
+
+    private:
+      T* first_;
+      size_type rows_, cols_, stride_;
+      size_type row_offset_, col_offset_;
+    };
+
+  // View of the whole of a.
+  template<typename A>
+      requires Multi_array<A> && (std::remove_const_t<A>::order() == 2)
+    auto make_view(A& a) noexcept
+    {
+      using B = std::remove_const_t<A>;
+      using T = std::conditional_t<std::is_const_v<A>, const typename B::element_type,
+                                   typename B::element_type>;
+      constexpr auto e = multi_array_extents_v<B>;
+      return multi_array_view<T>(a.data(), e[0], e[1], e[1]);
+    }
+
+  // Calls f(view) for each TY x TX tile of a. Tiles are visited row of
+  // tiles by row of tiles, so a band of TY rows is finished while it is
+  // still in cache. With threads != 1 (0: one per hardware thread) the
+  // bands are shared out in contiguous runs and f must be safe to call
+  // concurrently on disjoint tiles.
+  template<std::size_t TY, std::size_t TX, typename A, typename F>
+      requires Multi_array<A> && (std::remove_const_t<A>::order() == 2)
+               && (TY > 0) && (TX > 0)
+    void for_each_tile(A& a, F f, std::size_t threads = 1)
+    {
+      constexpr auto e = multi_array_extents_v<std::remove_const_t<A>>;
+      constexpr std::size_t bands = (e[0] + TY - 1) / TY;
+      const auto whole = make_view(a);
+      auto band = [&](std::size_t b) {
+        const std::size_t i = b * TY, rows = std::min(TY, e[0] - i);
+        for (std::size_t j = 0; j < e[1]; j += TX)
+          f(decltype(whole)(whole.row(i) + j, rows, std::min(TX, e[1] - j),
+                            e[1], i, j));
+      };
+      const std::size_t n = std::min(thread_count_impl(threads), bands);
+      if (n <= 1) {
+        for (std::size_t b = 0; b < bands; ++b) band(b);
+        return;
+      }
+      parallel_for_impl(n, [&](std::size_t t) {
+        for (std::size_t b = bands * t / n; b < bands * (t + 1) / n; ++b) band(b);
+      }, "tile_band");
+    }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_TILE_H
@@ -0,0 +1,234 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Timeline of library work in the Chrome trace-event format, viewable in
+// chrome://tracing or Perfetto. Spans are compiled in by defining
+// TB_MULTI_ARRAY_TIMELINE before including multi_array.h and recorded only
+// between timeline_start() and timeline_stop(); while stopped a span costs
+// one relaxed atomic load. Each thread writes completed spans into its own
+// ring buffer, which keeps the most recent timeline_capacity spans; the
+// buffer of an exited thread is handed to the next new thread.
+
+#ifndef TB_MULTI_ARRAY_TIMELINE_H
+#define TB_MULTI_ARRAY_TIMELINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace tb {
+
+  // Spans kept per thread; older spans are overwritten.
+  inline constexpr std::size_t timeline_capacity = std::size_t{1} << 14;
+
+  struct timeline_event {
+    const char* name;      // string literals only; they are not copied
+    const char* category;
+    std::int64_t start_ns;
+    std::int64_t duration_ns;
+    std::int64_t arg;      // task index, byte count, ...; -1 for none
+  };
+
+  struct timeline_buffer_impl {
+    explicit timeline_buffer_impl(unsigned id) : tid(id) {}
+
+    const unsigned tid;
+    std::atomic<std::uint64_t> head{0};  // spans ever written
+    std::unique_ptr<timeline_event[]> events{new timeline_event[timeline_capacity]};
+
+    void push(const timeline_event& e) noexcept
+    {
+      const auto h = head.load(std::memory_order_relaxed);
+      events[h % timeline_capacity] = e;
+      head.store(h + 1, std::memory_order_release);
+    }
+  };
+
+  struct timeline_registry_impl {
+    std::atomic<bool> enabled{false};
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    std::vector<std::unique_ptr<timeline_buffer_impl>> buffers;
+    std::vector<timeline_buffer_impl*> free;  // of exited threads
+
+    static timeline_registry_impl& get()
+    {
+      static timeline_registry_impl instance;
+      return instance;
+    }
+
+    std::int64_t now() const noexcept
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - epoch).count();
+    }
+  };
+
+  // Returns a thread's buffer to the registry when the thread exits.
+  struct timeline_thread_impl {
+    timeline_buffer_impl* buffer = nullptr;
+
+    ~timeline_thread_impl()
+    {
+      if (!buffer) return;
+      auto& registry = timeline_registry_impl::get();
+      std::lock_guard lock(registry.mutex);
+      registry.free.push_back(buffer);
+    }
+  };
+
+  // The calling thread's buffer, taken on its first recorded span. Buffers
+  // outlive their threads so that short-lived workers stay on the timeline,
+  // and are reused by later threads, so that spawning workers repeatedly
+  // needs no more buffers than were ever running at once.
+  inline timeline_buffer_impl& timeline_buffer()
+  {
+    thread_local timeline_thread_impl thread;
+    if (!thread.buffer) {
+      auto& registry = timeline_registry_impl::get();
+      std::lock_guard lock(registry.mutex);
+      if (!registry.free.empty()) {
+        thread.buffer = registry.free.back();
+        registry.free.pop_back();
+      } else {
+        const auto tid = static_cast<unsigned>(registry.buffers.size() + 1);
+        registry.buffers.push_back(std::make_unique<timeline_buffer_impl>(tid));
+        thread.buffer = registry.buffers.back().get();
+      }
+    }
+    return *thread.buffer;
+  }
+
+  inline void timeline_start() noexcept
+  { timeline_registry_impl::get().enabled.store(true, std::memory_order_relaxed); }
+
+  inline void timeline_stop() noexcept
+  { timeline_registry_impl::get().enabled.store(false, std::memory_order_relaxed); }
+
+  inline bool timeline_enabled() noexcept
+  { return timeline_registry_impl::get().enabled.load(std::memory_order_relaxed); }
+
+  // Records its own lifetime as one complete ("X") event on this thread.
+  class timeline_span {
+  public:
+    timeline_span(const char* category, const char* name,
+                  std::int64_t arg = -1) noexcept
+    {
+      if (!timeline_enabled()) return;
+      event_ = { name, category, timeline_registry_impl::get().now(), 0, arg };
+      active_ = true;
+    }
+
+    timeline_span(const timeline_span&) = delete;
+    timeline_span& operator=(const timeline_span&) = delete;
+
+    ~timeline_span()
+    {
+      if (!active_) return;
+      event_.duration_ns = timeline_registry_impl::get().now() - event_.start_ns;
+      try { timeline_buffer().push(event_); } catch (...) {}
+    }
+
+  private:
+    timeline_event event_;
+    bool active_ = false;
+  };
+
+  // Discards every recorded span. Call it while stopped.
+  inline void timeline_clear()
+  {
+    auto& registry = timeline_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    for (auto& b : registry.buffers) b->head.store(0, std::memory_order_relaxed);
+  }
+
+  inline void timeline_json_string_impl(std::string& out, const char* s)
+  {
+    out += '"';
+    for (; *s; ++s) {
+      if (*s == '"' || *s == '\\') out += '\\';
+      if (static_cast<unsigned char>(*s) >= 0x20) out += *s;
+    }
+    out += '"';
+  }
+
+  // The recorded spans as a Chrome trace-event JSON document. Call it once
+  // the traced work has finished; spans still being written may be torn.
+  inline std::string timeline_json()
+  {
+    auto& registry = timeline_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    char buf[160];
+    bool first = true;
+    auto separator = [&] { if (!first) out += ",\n"; first = false; };
+    for (const auto& b : registry.buffers) {
+      separator();
+      std::snprintf(buf, sizeof buf,
+                    "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,"
+                    "\"args\":{\"name\":\"thread %u\"}}", b->tid, b->tid);
+      out += buf;
+      const std::uint64_t head = b->head.load(std::memory_order_acquire);
+      const std::uint64_t count = std::min<std::uint64_t>(head, timeline_capacity);
+      for (std::uint64_t i = head - count; i < head; ++i) {
+        const timeline_event& e = b->events[i % timeline_capacity];
+        separator();
+        out += "{\"ph\":\"X\",\"name\":";
+        timeline_json_string_impl(out, e.name);
+        out += ",\"cat\":";
+        timeline_json_string_impl(out, e.category);
+        std::snprintf(buf, sizeof buf, ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                      b->tid, e.start_ns / 1e3, e.duration_ns / 1e3);
+        out += buf;
+        if (e.arg >= 0) {
+          std::snprintf(buf, sizeof buf, ",\"args\":{\"n\":%lld}", (long long)e.arg);
+          out += buf;
+        }
+        out += '}';
+      }
+    }
+    return out + "\n]}\n";
+  }
+
+  // Writes timeline_json() to path. Throws std::runtime_error on failure.
+  inline void save_timeline(const std::filesystem::path& path)
+  {
+    const std::string text = timeline_json();
+    std::FILE* f = std::fopen(path.string().c_str(), "wb");
+    if (!f)
+      throw std::runtime_error("multi_array: cannot open " + path.string());
+    const bool written = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (std::fclose(f) != 0 || !written)
+      throw std::runtime_error("multi_array: cannot write " + path.string());
+  }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_TIMELINE_H
@@ -0,0 +1,374 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Access-pattern instrumentation, enabled by defining TB_MULTI_ARRAY_TRACE
+// before including multi_array.h. Every element access made by operator(),
+// at(), operator[] or an iterator is then recorded against the outermost
+// array it was made through: a[i][j] and loops over the rows of a count
+// towards a, not towards its rows, until a is destroyed. Without the macro this header is not
+// included and the accessors compile exactly as before.
+
+#ifndef TB_MULTI_ARRAY_TRACE_H
+#define TB_MULTI_ARRAY_TRACE_H
+
+#include <algorithm>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace tb {
+
+  enum class trace_kind { call, at, subscript, iterator };
+
+  // Access statistics of one array instance.
+  struct trace_stats {
+    // Number of strides histogrammed; bucket 0 counts repeated accesses to
+    // the same address, bucket k counts |stride| in [2^(k-1), 2^k) elements.
+    static constexpr std::size_t buckets = 34;
+
+    const std::type_info* type = nullptr;
+    std::uint64_t accesses[4] = {};       // indexed by trace_kind
+    std::uint64_t sequential = 0;         // same or next object
+    std::uint64_t random = 0;
+    std::uint64_t backward = 0;           // negative strides
+    std::uint64_t strides[buckets] = {};  // in units of the element type
+    std::uintptr_t last = 0;
+
+    std::uint64_t total() const noexcept
+    { return accesses[0] + accesses[1] + accesses[2] + accesses[3]; }
+
+    double sequential_ratio() const noexcept
+    {
+      const auto n = sequential + random;
+      return n ? static_cast<double>(sequential) / n : 0.0;
+    }
+  };
+
+  // The first trace_log_limit element accesses of one array instance, as
+  // row-major element offsets, for replay by multi_array_layout.h.
+  inline constexpr std::size_t trace_log_limit = std::size_t{1} << 20;
+
+  struct trace_log {
+    const std::type_info* type = nullptr;
+    std::vector<std::size_t> extents;  // outermost first
+    std::size_t element_size = 0;
+    std::vector<std::uint64_t> offsets;
+  };
+
+  // Type and size of a traced array.
+  struct trace_owner_impl {
+    std::size_t size = 0;
+    const std::type_info* type = nullptr;
+    const std::type_info* element = nullptr;
+    std::size_t element_size = 0;
+    std::vector<std::size_t> (*extents)() = nullptr;
+  };
+
+  struct trace_registry_impl {
+    using key = std::pair<const void*, std::type_index>;
+
+    std::mutex mutex;
+    std::map<key, trace_stats> arrays;
+    std::map<key, trace_log> logs;
+    // Disjoint address ranges of the outermost arrays whose sub-arrays
+    // have been handed out, by start address.
+    std::map<const void*, trace_owner_impl> owners;
+
+    static trace_registry_impl& get()
+    {
+      static trace_registry_impl instance;
+      return instance;
+    }
+  };
+
+  // Nesting depth of traced accessors on this thread. Rank-N accessors are
+  // implemented through their sub-arrays; only the outermost call is kept.
+  inline int& trace_depth_impl() noexcept
+  {
+    thread_local int depth = 0;
+    return depth;
+  }
+
+  // Extents of a multi_array type, outermost first.
+  template<typename A>
+    std::vector<std::size_t> trace_extents_impl()
+    {
+      std::vector<std::size_t> extents{ A::size() };
+      if constexpr (requires { A::value_type::order(); }) {
+        const auto inner = trace_extents_impl<typename A::value_type>();
+        extents.insert(extents.end(), inner.begin(), inner.end());
+      }
+      return extents;
+    }
+
+  template<typename A>
+    const trace_owner_impl& trace_owner_for_impl()
+    {
+      static const trace_owner_impl owner{ sizeof(A), &typeid(A),
+                                           &typeid(typename A::element_type),
+                                           sizeof(typename A::element_type),
+                                           trace_extents_impl<A> };
+      return owner;
+    }
+
+  // Notes that a sub-array of array was handed out, so that accesses made
+  // through it are attributed to array, or to the array enclosing it.
+  inline void trace_enclose(const void* array, const trace_owner_impl& owner)
+  {
+    auto& registry = trace_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    auto& owners = registry.owners;
+    const char* first = static_cast<const char*>(array);
+    const char* last = first + owner.size;
+    auto it = owners.upper_bound(array);
+    if (it != owners.begin()) {
+      const auto prev = std::prev(it);
+      const char* start = static_cast<const char*>(prev->first);
+      const bool overlaps = start + prev->second.size > first;
+      if (overlaps && start + prev->second.size >= last
+          && *prev->second.element == *owner.element)
+        return;
+      if (overlaps) it = prev;
+    }
+    // The ranges this one overlaps are its own sub-arrays or stale.
+    while (it != owners.end() && static_cast<const char*>(it->first) < last)
+      it = owners.erase(it);
+    owners.emplace(array, owner);
+  }
+
+  // Forgets the owner ranges within an array that is being destroyed, so
+  // that arrays later created in its storage are not taken for its
+  // sub-arrays.
+  inline void trace_forget(const void* array, std::size_t size)
+  {
+    auto& registry = trace_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    const char* last = static_cast<const char*>(array) + size;
+    auto it = registry.owners.lower_bound(array);
+    while (it != registry.owners.end() && static_cast<const char*>(it->first) < last)
+      it = registry.owners.erase(it);
+  }
+
+  // Records an access to the element object of array, or of the outermost
+  // array enclosing array.
+  inline void
+  trace_record(const void* array, const trace_owner_impl& self, trace_kind kind,
+               const void* object)
+  {
+    auto& registry = trace_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    const void* base = array;
+    const trace_owner_impl* owner = &self;
+    auto it = registry.owners.upper_bound(array);
+    if (it != registry.owners.begin()) {
+      const auto& [start, enclosing] = *std::prev(it);
+      const auto offset = static_cast<std::size_t>(static_cast<const char*>(array)
+                                                   - static_cast<const char*>(start));
+      if (offset + self.size <= enclosing.size && offset % self.size == 0
+          && *enclosing.element == *self.element) {
+        base = start;
+        owner = &enclosing;
+      }
+    }
+    const trace_registry_impl::key key{ base, std::type_index(*owner->type) };
+    const std::size_t element_size = owner->element_size;
+
+    trace_log& log = registry.logs[key];
+    if (log.offsets.empty()) {
+      log.type = owner->type;
+      log.extents = owner->extents();
+      log.element_size = element_size;
+    }
+    if (log.offsets.size() < trace_log_limit)
+      log.offsets.push_back((static_cast<const char*>(object)
+                             - static_cast<const char*>(base)) / element_size);
+
+    trace_stats& s = registry.arrays[key];
+    s.type = owner->type;
+    const auto address = reinterpret_cast<std::uintptr_t>(object);
+    if (s.total() > 0) {
+      const bool back = address < s.last;
+      const std::uintptr_t delta = back ? s.last - address : address - s.last;
+      if (!back && delta <= element_size) ++s.sequential;
+      else ++s.random;
+      if (back) ++s.backward;
+      const std::uintptr_t stride = delta / element_size;
+      ++s.strides[std::min<std::size_t>(std::bit_width(stride),
+                                        trace_stats::buckets - 1)];
+    }
+    ++s.accesses[static_cast<int>(kind)];
+    s.last = address;
+  }
+
+  // Evaluates the accessor f and records the element it returns against
+  // array; a sub-array it returns is noted as belonging to array. Nothing
+  // is recorded during constant evaluation.
+  template<typename A, typename F>
+    constexpr decltype(auto) trace_access(trace_kind kind, const A* array, F f)
+    {
+      if (std::is_constant_evaluated()) return f();
+      ++trace_depth_impl();
+      decltype(auto) result = f();
+      if (--trace_depth_impl() == 0) {
+        using R = std::remove_cvref_t<decltype(result)>;
+        if constexpr (std::is_same_v<R, typename A::element_type>)
+          trace_record(array, trace_owner_for_impl<A>(), kind, &result);
+        else
+          trace_enclose(array, trace_owner_for_impl<A>());
+      }
+      return result;
+    }
+
+  // Contiguous iterator over the sub-arrays or elements of A that records
+  // every dereference.
+  template<typename V, typename A>
+    class traced_iterator {
+    public:
+      using iterator_category = std::random_access_iterator_tag;
+      using iterator_concept  = std::contiguous_iterator_tag;
+      using value_type        = std::remove_cv_t<V>;
+      using difference_type   = std::ptrdiff_t;
+      using pointer           = V*;
+      using reference         = V&;
+
+      constexpr traced_iterator() noexcept = default;
+      constexpr traced_iterator(V* p, const A* owner) noexcept
+        : p_(p), owner_(owner) {}
+
+      // Conversion from iterator to const_iterator.
+      template<typename U>
+          requires std::is_convertible_v<U*, V*>
+        constexpr traced_iterator(const traced_iterator<U, A>& i) noexcept
+          : p_(i.base()), owner_(i.owner()) {}
+
+      constexpr V* base() const noexcept { return p_; }
+      constexpr const A* owner() const noexcept { return owner_; }
+
+      constexpr reference operator*() const noexcept
+      { return trace_access(trace_kind::iterator, owner_, [&]() -> V& { return *p_; }); }
+      constexpr pointer operator->() const noexcept { return &**this; }
+      constexpr reference operator[](difference_type n) const noexcept
+      { return *(*this + n); }
+
+      constexpr traced_iterator& operator++() noexcept { ++p_; return *this; }
+      constexpr traced_iterator& operator--() noexcept { --p_; return *this; }
+      constexpr traced_iterator operator++(int) noexcept { auto t = *this; ++p_; return t; }
+      constexpr traced_iterator operator--(int) noexcept { auto t = *this; --p_; return t; }
+      constexpr traced_iterator& operator+=(difference_type n) noexcept { p_ += n; return *this; }
+      constexpr traced_iterator& operator-=(difference_type n) noexcept { p_ -= n; return *this; }
+
+      friend constexpr traced_iterator operator+(traced_iterator i, difference_type n) noexcept
+      { return i += n; }
+      friend constexpr traced_iterator operator+(difference_type n, traced_iterator i) noexcept
+      { return i += n; }
+      friend constexpr traced_iterator operator-(traced_iterator i, difference_type n) noexcept
+      { return i -= n; }
+      friend constexpr difference_type operator-(const traced_iterator& a, const traced_iterator& b) noexcept
+      { return a.p_ - b.p_; }
+      friend constexpr bool operator==(const traced_iterator& a, const traced_iterator& b) noexcept
+      { return a.p_ == b.p_; }
+      friend constexpr auto operator<=>(const traced_iterator& a, const traced_iterator& b) noexcept
+      { return a.p_ <=> b.p_; }
+
+    private:
+      V* p_ = nullptr;
+      const A* owner_ = nullptr;
+    };
+
+  // Statistics recorded for the instance a, or empty statistics.
+  template<typename A>
+    trace_stats trace_stats_for(const A& a)
+    {
+      auto& registry = trace_registry_impl::get();
+      std::lock_guard lock(registry.mutex);
+      auto it = registry.arrays.find({ &a, std::type_index(typeid(A)) });
+      return it == registry.arrays.end() ? trace_stats{} : it->second;
+    }
+
+  // Copies the statistics of every traced instance, keyed by address.
+  inline std::vector<std::pair<const void*, trace_stats>> trace_snapshot()
+  {
+    auto& registry = trace_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    std::vector<std::pair<const void*, trace_stats>> arrays;
+    for (const auto& [key, s] : registry.arrays) arrays.emplace_back(key.first, s);
+    return arrays;
+  }
+
+  // Copies the access logs of every traced instance, keyed by address.
+  inline std::vector<std::pair<const void*, trace_log>> trace_logs()
+  {
+    auto& registry = trace_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    std::vector<std::pair<const void*, trace_log>> logs;
+    for (const auto& [key, log] : registry.logs) logs.emplace_back(key.first, log);
+    return logs;
+  }
+
+  inline void trace_reset()
+  {
+    auto& registry = trace_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    registry.arrays.clear();
+    registry.logs.clear();
+    registry.owners.clear();
+  }
+
+  // Prints one line per traced instance, most accessed first, with the
+  // access counts, sequential ratio and non-empty stride buckets.
+  inline void trace_report(std::FILE* out = stderr)
+  {
+    auto arrays = trace_snapshot();
+    std::sort(arrays.begin(), arrays.end(), [](const auto& a, const auto& b) {
+      return a.second.total() > b.second.total();
+    });
+    for (const auto& [address, s] : arrays) {
+      std::fprintf(out, "%p %s: () %llu, at %llu, [] %llu, iter %llu, "
+                   "sequential %.1f%%, backward %llu, strides",
+                   address, s.type ? s.type->name() : "?",
+                   (unsigned long long)s.accesses[0],
+                   (unsigned long long)s.accesses[1],
+                   (unsigned long long)s.accesses[2],
+                   (unsigned long long)s.accesses[3],
+                   100 * s.sequential_ratio(), (unsigned long long)s.backward);
+      for (std::size_t b = 0; b < trace_stats::buckets; ++b) {
+        if (!s.strides[b]) continue;
+        if (b == 0) std::fprintf(out, " 0:");
+        else std::fprintf(out, " <%llu:", 1ull << b);
+        std::fprintf(out, "%llu", (unsigned long long)s.strides[b]);
+      }
+      std::fprintf(out, "\n");
+    }
+  }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_TRACE_H
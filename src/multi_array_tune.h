@@ -0,0 +1,210 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Machine-specific tuning of kernel parameters. A tuner times candidate
+// values of one parameter and the fastest is cached, keyed by CPU model, in
+// a local file so that later runs reuse it without measuring. Kernels read
+// their parameters with tuned_value(); autotune() runs every registered
+// tuner, e.g. once at startup. Setting TB_MULTI_ARRAY_AUTOTUNE=1 in the
+// environment instead tunes each parameter on its first use.
+//
+// The cache is $TB_MULTI_ARRAY_TUNE_CACHE if set, otherwise
+// $XDG_CACHE_HOME/multi_array/tune.txt or ~/.cache/multi_array/tune.txt.
+// Each line holds "cpu model<TAB>key<TAB>value"; later lines win.
+
+#ifndef TB_MULTI_ARRAY_TUNE_H
+#define TB_MULTI_ARRAY_TUNE_H
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tb {
+
+  // The processor's model name and hardware thread count, e.g.
+  // "AMD EPYC 7B13 x8".
+  inline const std::string& cpu_model()
+  {
+    static const std::string model = [] {
+      std::string name = "unknown";
+      if (std::FILE* f = std::fopen("/proc/cpuinfo", "r")) {
+        char line[512];
+        while (std::fgets(line, sizeof line, f)) {
+          if (std::strncmp(line, "model name", 10) != 0) continue;
+          const char* colon = std::strchr(line, ':');
+          if (!colon) continue;
+          name = colon + 1 + (colon[1] == ' ');
+          while (!name.empty() && (name.back() == '\n' || name.back() == ' '))
+            name.pop_back();
+          break;
+        }
+        std::fclose(f);
+      }
+      std::replace(name.begin(), name.end(), '\t', ' ');
+      return name + " x" + std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+    }();
+    return model;
+  }
+
+  inline std::filesystem::path tuning_cache_path()
+  {
+    if (const char* p = std::getenv("TB_MULTI_ARRAY_TUNE_CACHE")) return p;
+    if (const char* p = std::getenv("XDG_CACHE_HOME"))
+      return std::filesystem::path(p) / "multi_array" / "tune.txt";
+    if (const char* p = std::getenv("HOME"))
+      return std::filesystem::path(p) / ".cache" / "multi_array" / "tune.txt";
+    return {};
+  }
+
+  struct tuning_registry_impl {
+    std::recursive_mutex mutex;
+    bool loaded = false;
+    std::map<std::string, long> values;  // this CPU's cached parameters
+    std::map<std::string, std::function<long()>> tuners;
+
+    static tuning_registry_impl& get()
+    {
+      static tuning_registry_impl instance;
+      return instance;
+    }
+
+    void load()
+    {
+      if (loaded) return;
+      loaded = true;
+      const auto path = tuning_cache_path();
+      std::FILE* f = path.empty() ? nullptr : std::fopen(path.string().c_str(), "r");
+      if (!f) return;
+      char line[1024];
+      while (std::fgets(line, sizeof line, f)) {
+        char* key = std::strchr(line, '\t');
+        char* value = key ? std::strchr(key + 1, '\t') : nullptr;
+        if (!value) continue;
+        *key++ = '\0';
+        *value++ = '\0';
+        if (cpu_model() == line) values[key] = std::strtol(value, nullptr, 10);
+      }
+      std::fclose(f);
+    }
+
+    // Appends to the cache file; failures only lose the cache.
+    void store(const std::string& key, long value)
+    {
+      values[key] = value;
+      const auto path = tuning_cache_path();
+      if (path.empty()) return;
+      std::error_code ec;
+      std::filesystem::create_directories(path.parent_path(), ec);
+      if (std::FILE* f = std::fopen(path.string().c_str(), "a")) {
+        std::fprintf(f, "%s\t%s\t%ld\n", cpu_model().c_str(), key.c_str(), value);
+        std::fclose(f);
+      }
+    }
+  };
+
+  // Registers the tuner of key, which measures and returns the best value.
+  // Returns true so that it can initialize an inline variable.
+  inline bool register_tuner(const std::string& key, std::function<long()> tuner)
+  {
+    auto& registry = tuning_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    registry.tuners[key] = std::move(tuner);
+    return true;
+  }
+
+  inline bool autotune_on_first_use()
+  {
+    static const bool enabled = [] {
+      const char* e = std::getenv("TB_MULTI_ARRAY_AUTOTUNE");
+      return e && *e && std::strcmp(e, "0") != 0;
+    }();
+    return enabled;
+  }
+
+  // The tuned value of key for this CPU. Without a cached value it is
+  // measured when first-use tuning is enabled, otherwise fallback is used.
+  inline long tuned_value(const std::string& key, long fallback)
+  {
+    auto& registry = tuning_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    registry.load();
+    if (auto it = registry.values.find(key); it != registry.values.end())
+      return it->second;
+    auto tuner = registry.tuners.find(key);
+    if (!autotune_on_first_use() || tuner == registry.tuners.end()) return fallback;
+    const long value = tuner->second();
+    registry.store(key, value);
+    return value;
+  }
+
+  // Runs every registered tuner and caches the results, replacing values
+  // cached earlier for this CPU.
+  inline void autotune()
+  {
+    auto& registry = tuning_registry_impl::get();
+    std::lock_guard lock(registry.mutex);
+    registry.load();
+    for (auto& [key, tuner] : registry.tuners) registry.store(key, tuner());
+  }
+
+  // Returns the candidate for which measure(candidate) runs fastest, taking
+  // the best of a few repetitions of each. prepare(candidate) runs untimed
+  // before every repetition, e.g. to evict the data measure() reads.
+  template<typename F, typename P>
+    requires std::invocable<P&, long>
+    long fastest_candidate(const std::vector<long>& candidates, F measure,
+                           P prepare, int repetitions = 3)
+    {
+      using clock = std::chrono::steady_clock;
+      long best = candidates.front();
+      auto best_time = clock::duration::max();
+      for (long c : candidates) {
+        auto time = clock::duration::max();
+        for (int r = 0; r < repetitions; ++r) {
+          prepare(c);
+          const auto start = clock::now();
+          measure(c);
+          time = std::min(time, clock::now() - start);
+        }
+        if (time < best_time) { best_time = time; best = c; }
+      }
+      return best;
+    }
+
+  template<typename F>
+    long fastest_candidate(const std::vector<long>& candidates, F measure,
+                           int repetitions = 3)
+    { return fastest_candidate(candidates, measure, [](long) {}, repetitions); }
+
+} // namespace tb
+#endif//TB_MULTI_ARRAY_TUNE_H
@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Round trips through Arrow Tensor IPC messages, on disk and in memory,
+// and rejection of messages that do not describe the array type.
+//
+//   g++ -std=c++20 -O2 -I src test/arrow_test.cpp && ./a.out
+
+#include "multi_array_arrow.h"
+#include "test.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <new>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  // The bytes of a file, 64-byte aligned as they would be when mapped.
+  struct message {
+    explicit message(const std::filesystem::path& path)
+      : size(std::filesystem::file_size(path)),
+        bytes(new (std::align_val_t{64}) unsigned char[size])
+    {
+      std::FILE* f = std::fopen(path.string().c_str(), "rb");
+      TB_CHECK(f && std::fread(bytes.get(), 1, size, f) == size);
+      if (f) std::fclose(f);
+    }
+
+    struct aligned_delete {
+      void operator()(unsigned char* p) const
+      { ::operator delete[](p, std::align_val_t{64}); }
+    };
+
+    std::size_t size;
+    std::unique_ptr<unsigned char[], aligned_delete> bytes;
+  };
+
+  template<typename A, typename F>
+    void round_trip(const char* name, F value)
+    {
+      using T = typename A::element_type;
+      A a;
+      std::size_t k = 0;
+      for (auto* p = a.data(); p != a.data() + A::total_size(); ++p)
+        *p = static_cast<T>(value(k++));
+      const temp_file file(name);
+      save_arrow_tensor(file.path, a);
+      TB_CHECK(std::filesystem::file_size(file.path) % 8 == 0);
+      TB_CHECK(load_arrow_tensor<A>(file.path) == a);
+
+      const message m(file.path);
+      const A& view = arrow_tensor_view<A>(m.bytes.get(), m.size);
+      TB_CHECK(view == a);
+      const auto* data = reinterpret_cast<const unsigned char*>(view.data());
+      TB_CHECK(data > m.bytes.get() && data + sizeof(A) <= m.bytes.get() + m.size);
+      TB_CHECK(throws([&] { arrow_tensor_view<A>(m.bytes.get(), m.size - 8 - sizeof(A)); }));
+      TB_CHECK(throws([&] { arrow_tensor_view<A>(m.bytes.get(), 4); }));
+    }
+
+  void errors()
+  {
+    const temp_file file("arrow_errors");
+    multi_array<std::int32_t, 4, 6> a{};
+    save_arrow_tensor(file.path, a);
+    TB_CHECK(!throws([&] { load_arrow_tensor<multi_array<std::int32_t, 4, 6>>(file.path); }));
+    TB_CHECK(throws([&] { load_arrow_tensor<multi_array<std::int32_t, 6, 4>>(file.path); }));
+    TB_CHECK(throws([&] { load_arrow_tensor<multi_array<std::int32_t, 24>>(file.path); }));
+    TB_CHECK(throws([&] { load_arrow_tensor<multi_array<std::int32_t, 2, 2, 6>>(file.path); }));
+    TB_CHECK(throws([&] { load_arrow_tensor<multi_array<std::uint32_t, 4, 6>>(file.path); }));
+    TB_CHECK(throws([&] { load_arrow_tensor<multi_array<std::int64_t, 4, 6>>(file.path); }));
+    TB_CHECK(throws([&] { load_arrow_tensor<multi_array<float, 4, 6>>(file.path); }));
+    std::filesystem::resize_file(file.path, std::filesystem::file_size(file.path) - 8);
+    TB_CHECK(throws([&] { load_arrow_tensor<multi_array<std::int32_t, 4, 6>>(file.path); }));
+    std::filesystem::resize_file(file.path, 6);
+    TB_CHECK(throws([&] { load_arrow_tensor<multi_array<std::int32_t, 4, 6>>(file.path); }));
+    TB_CHECK(throws([&] { load_arrow_tensor<multi_array<std::int32_t, 4, 6>>(file.path.string() + ".missing"); }));
+  }
+
+} // namespace
+
+int main()
+{
+  round_trip<multi_array<std::int8_t, 3, 5>>("arrow_i8", [](std::size_t k) { return int(k) - 7; });
+  round_trip<multi_array<std::uint16_t, 9>>("arrow_u16", [](std::size_t k) { return k * 4099; });
+  round_trip<multi_array<std::int32_t, 2, 3, 4>>("arrow_i32", [](std::size_t k) { return -1000 * int(k); });
+  round_trip<multi_array<std::uint64_t, 5, 5>>("arrow_u64", [](std::size_t k) { return k << 40; });
+  round_trip<multi_array<float, 16, 16>>("arrow_f32", [](std::size_t k) { return k * 0.5 - 3; });
+  round_trip<multi_array<double, 7, 1, 3>>("arrow_f64", [](std::size_t k) { return 1.0 / (k + 1); });
+  errors();
+  return report("arrow_test");
+}
@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Round trips through the binary file format, in both byte orders.
+//
+//   g++ -std=c++20 -O2 -I src test/binary_test.cpp && ./a.out
+
+#include "multi_array_binary.h"
+#include "test.h"
+
+#include <cstdint>
+#include <filesystem>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  template<typename A, typename F>
+    void round_trip(const char* name, F value)
+    {
+      A a;
+      std::size_t k = 0;
+      for (auto* p = a.data(); p != a.data() + A::total_size(); ++p)
+        *p = value(k++);
+      for (std::endian order : { std::endian::little, std::endian::big }) {
+        const temp_file file(name);
+        save_binary(file.path, a, order);
+        TB_CHECK(std::filesystem::file_size(file.path)
+                 == 8 + 8 * A::order() + sizeof(typename A::element_type) * A::total_size());
+        TB_CHECK(load_binary<A>(file.path) == a);
+      }
+    }
+
+  void errors()
+  {
+    const temp_file file("binary_errors");
+    multi_array<float, 4, 8> a{};
+    save_binary(file.path, a);
+    TB_CHECK(throws([&] { load_binary<multi_array<float, 8, 4>>(file.path); }));
+    TB_CHECK(throws([&] { load_binary<multi_array<float, 32>>(file.path); }));
+    TB_CHECK(throws([&] { load_binary<multi_array<double, 4, 8>>(file.path); }));
+    TB_CHECK(throws([&] { load_binary<multi_array<std::int32_t, 4, 8>>(file.path); }));
+    std::filesystem::resize_file(file.path, std::filesystem::file_size(file.path) - 1);
+    TB_CHECK(throws([&] { load_binary<multi_array<float, 4, 8>>(file.path); }));
+    std::filesystem::resize_file(file.path, 3);
+    TB_CHECK(throws([&] { load_binary<multi_array<float, 4, 8>>(file.path); }));
+    TB_CHECK(throws([&] { load_binary<multi_array<float, 4, 8>>(file.path.string() + ".missing"); }));
+  }
+
+} // namespace
+
+int main()
+{
+  round_trip<multi_array<std::uint8_t, 7>>("binary_u8", [](std::size_t k) { return k * 37; });
+  round_trip<multi_array<std::int16_t, 3, 5>>("binary_i16", [](std::size_t k) { return 1000 - 300 * int(k); });
+  round_trip<multi_array<std::uint32_t, 2, 3, 4>>("binary_u32", [](std::size_t k) { return 0x01020304u * k; });
+  round_trip<multi_array<std::int64_t, 5, 2>>("binary_i64", [](std::size_t k) { return -(std::int64_t{1} << 40) * k; });
+  round_trip<multi_array<float, 16, 16>>("binary_f32", [](std::size_t k) { return k * 0.25f - 7; });
+  round_trip<multi_array<double, 3, 1000>>("binary_f64", [](std::size_t k) { return 1.0 / (k + 1); });
+  // Larger than the staging buffer, so that byte swapping takes several chunks.
+  round_trip<multi_array<std::uint16_t, 600, 1024>>("binary_large", [](std::size_t k) { return k; });
+  errors();
+  return report("binary_test");
+}
@@ -0,0 +1,143 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Round trips through DLPack export and import, and rejection of tensors
+// that do not match the array type.
+//
+//   g++ -std=c++20 -O2 -I src test/dlpack_test.cpp && ./a.out
+
+#include "multi_array_dlpack.h"
+#include "test.h"
+
+#include <cstdint>
+#include <memory>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  using matrix = multi_array<float, 3, 4>;
+
+  // Exports a matrix and counts the calls of its deleter.
+  struct counted_export {
+    counted_export()
+      : tensor(to_dlpack(source))
+    {
+      wrapped = *tensor;
+      wrapped.manager_ctx = this;
+      wrapped.deleter = [](DLManagedTensor* self) {
+        auto* e = static_cast<counted_export*>(self->manager_ctx);
+        ++e->deleted;
+        e->tensor->deleter(e->tensor);
+      };
+    }
+
+    matrix source{};
+    DLManagedTensor* tensor;
+    DLManagedTensor wrapped;
+    int deleted = 0;
+  };
+
+  void borrowed()
+  {
+    matrix a;
+    for (std::size_t i = 0; i < 3; ++i)
+      for (std::size_t j = 0; j < 4; ++j) a[i][j] = float(i * 10 + j);
+    DLManagedTensor* t = to_dlpack(a);
+    const DLTensor& dl = t->dl_tensor;
+    TB_CHECK(dl.data == a.data());
+    TB_CHECK(dl.device.device_type == kDLCPU);
+    TB_CHECK(dl.ndim == 2);
+    TB_CHECK(dl.shape[0] == 3 && dl.shape[1] == 4);
+    TB_CHECK(dl.strides[0] == 4 && dl.strides[1] == 1);
+    TB_CHECK(dl.dtype.code == kDLFloat && dl.dtype.bits == 32 && dl.dtype.lanes == 1);
+    TB_CHECK(dl.byte_offset == 0);
+
+    auto h = from_dlpack<matrix>(t);
+    TB_CHECK(&*h == &a);
+    TB_CHECK((*h)[2][3] == 23.0f);
+  }
+
+  void owned()
+  {
+    auto a = std::make_unique<multi_array<std::int16_t, 2, 3, 4>>();
+    for (std::size_t k = 0; k < 24; ++k) a->data()[k] = std::int16_t(k - 12);
+    const auto copy = *a;
+    const void* data = a->data();
+    auto h = from_dlpack<multi_array<std::int16_t, 2, 3, 4>>(to_dlpack(std::move(a)));
+    TB_CHECK(h->data() == data);
+    TB_CHECK(*h == copy);
+    TB_CHECK(h.get()->dl_tensor.dtype.code == kDLInt);
+  }
+
+  // from_dlpack() releases t through its deleter whether or not it throws.
+  template<typename A, typename F>
+    void rejects(F modify)
+    {
+      counted_export e;
+      modify(e.wrapped.dl_tensor);
+      TB_CHECK(throws([&] { from_dlpack<A>(&e.wrapped); }));
+      TB_CHECK(e.deleted == 1);
+    }
+
+  void mismatches()
+  {
+    {
+      counted_export e;
+      { auto h = from_dlpack<matrix>(&e.wrapped); }
+      TB_CHECK(e.deleted == 1);
+    }
+    TB_CHECK(throws([] { from_dlpack<matrix>(nullptr); }));
+    rejects<matrix>([](DLTensor& t) { t.device.device_type = DLDeviceType(0); });
+    rejects<matrix>([](DLTensor& t) { t.dtype.bits = 64; });
+    rejects<matrix>([](DLTensor& t) { t.dtype.code = kDLInt; });
+    rejects<matrix>([](DLTensor& t) { t.dtype.lanes = 4; });
+    rejects<multi_array<float, 12>>([](DLTensor&) {});
+    rejects<multi_array<float, 4, 3>>([](DLTensor&) {});
+    rejects<matrix>([](DLTensor& t) { t.strides[0] = 1; t.strides[1] = 3; });
+    rejects<matrix>([](DLTensor& t) { t.byte_offset = 2; });
+  }
+
+  // Strides of extent-1 dimensions are arbitrary, and may be omitted.
+  void strides()
+  {
+    multi_array<double, 1, 5> a{};
+    DLManagedTensor* t = to_dlpack(a);
+    t->dl_tensor.strides[0] = 42;
+    TB_CHECK(!throws([&] { from_dlpack<multi_array<double, 1, 5>>(t); }));
+    t = to_dlpack(a);
+    t->dl_tensor.strides = nullptr;
+    TB_CHECK(!throws([&] { from_dlpack<multi_array<double, 1, 5>>(t); }));
+  }
+
+} // namespace
+
+int main()
+{
+  borrowed();
+  owned();
+  mismatches();
+  strides();
+  return report("dlpack_test");
+}
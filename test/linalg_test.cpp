@@ -0,0 +1,280 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Numerical residuals of the LU and Cholesky factorizations and solvers,
+// for unrolled, blocked and threaded sizes, and of the vector kernels
+// against double precision references, for lengths on and off multiples
+// of their eight-wide unrolling.
+//
+//   g++ -std=c++20 -O2 -pthread -I src test/linalg_test.cpp && ./a.out
+
+#include "multi_array_linalg.h"
+#include "test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  // Deterministic pseudo-random value in [-1, 1).
+  double next(std::uint64_t& state)
+  {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return double(state >> 11) * 0x1p-52 - 1;
+  }
+
+  template<typename T, std::size_t N>
+    T max_abs(const multi_array<T, N, N>& a)
+    {
+      T m = 0;
+      for (std::size_t i = 0; i < N; ++i)
+        for (std::size_t j = 0; j < N; ++j) m = std::max(m, std::abs(a[i][j]));
+      return m;
+    }
+
+  // Residuals relative to |a| N epsilon stay small for a backward-stable
+  // factorization of a well-conditioned matrix.
+  template<typename T, std::size_t N>
+    bool small(T residual, T scale)
+    { return residual <= 64 * N * std::numeric_limits<T>::epsilon() * scale; }
+
+  template<typename T, std::size_t N>
+    void lu(std::size_t threads)
+    {
+      using matrix = multi_array<T, N, N>;
+      std::uint64_t state = N;
+      const auto a = std::make_unique<matrix>();
+      for (std::size_t i = 0; i < N; ++i)
+        for (std::size_t j = 0; j < N; ++j) (*a)[i][j] = T(next(state));
+      const auto lu = std::make_unique<matrix>(*a);
+      multi_array<std::size_t, N> pivots;
+      lu_factor(*lu, pivots, threads);
+
+      // P a, with the row swaps applied in order, against L U.
+      const auto pa = std::make_unique<matrix>(*a);
+      for (std::size_t k = 0; k < N; ++k) {
+        TB_CHECK(pivots[k] >= k && pivots[k] < N);
+        if (pivots[k] != k) (*pa)[k].swap((*pa)[pivots[k]]);
+      }
+      T residual = 0, largest_l = 0;
+      for (std::size_t i = 0; i < N; ++i)
+        for (std::size_t j = 0; j < N; ++j) {
+          T sum = 0;
+          for (std::size_t r = 0; r <= std::min(i, j); ++r)
+            sum += (r == i ? T(1) : (*lu)[i][r]) * (*lu)[r][j];
+          residual = std::max(residual, std::abs(sum - (*pa)[i][j]));
+          if (j < i) largest_l = std::max(largest_l, std::abs((*lu)[i][j]));
+        }
+      TB_CHECK((small<T, N>(residual, max_abs(*a))));
+      TB_CHECK(largest_l <= T(1));  // partial pivoting
+
+      multi_array<T, N> x, b;
+      for (std::size_t i = 0; i < N; ++i) x[i] = T(next(state));
+      for (std::size_t i = 0; i < N; ++i) {
+        b[i] = 0;
+        for (std::size_t j = 0; j < N; ++j) b[i] += (*a)[i][j] * x[j];
+      }
+      lu_solve(*lu, pivots, b);
+      T error = 0;
+      for (std::size_t i = 0; i < N; ++i) error = std::max(error, std::abs(b[i] - x[i]));
+      TB_CHECK(error <= T(N) * T(1e3) * std::numeric_limits<T>::epsilon());
+    }
+
+  template<typename T, std::size_t N>
+    void cholesky(std::size_t threads)
+    {
+      using matrix = multi_array<T, N, N>;
+      std::uint64_t state = 3 * N;
+      // b b^T + N I is symmetric positive definite.
+      const auto b = std::make_unique<matrix>();
+      for (std::size_t i = 0; i < N; ++i)
+        for (std::size_t j = 0; j < N; ++j) (*b)[i][j] = T(next(state));
+      const auto a = std::make_unique<matrix>();
+      for (std::size_t i = 0; i < N; ++i)
+        for (std::size_t j = 0; j < N; ++j) {
+          T sum = i == j ? T(N) : T(0);
+          for (std::size_t r = 0; r < N; ++r) sum += (*b)[i][r] * (*b)[j][r];
+          (*a)[i][j] = sum;
+        }
+      const auto l = std::make_unique<matrix>(*a);
+      for (std::size_t i = 0; i < N; ++i)  // only the lower triangle is read
+        for (std::size_t j = i + 1; j < N; ++j) (*l)[i][j] = T(-1e6);
+      tb::cholesky(*l, threads);
+
+      T residual = 0;
+      bool upper_zero = true;
+      for (std::size_t i = 0; i < N; ++i)
+        for (std::size_t j = 0; j < N; ++j) {
+          if (j > i) upper_zero = upper_zero && (*l)[i][j] == T(0);
+          T sum = 0;
+          for (std::size_t r = 0; r <= std::min(i, j); ++r) sum += (*l)[i][r] * (*l)[j][r];
+          residual = std::max(residual, std::abs(sum - (*a)[i][j]));
+        }
+      TB_CHECK(upper_zero);
+      TB_CHECK((small<T, N>(residual, max_abs(*a))));
+
+      multi_array<T, N> x, rhs;
+      for (std::size_t i = 0; i < N; ++i) x[i] = T(next(state));
+      for (std::size_t i = 0; i < N; ++i) {
+        rhs[i] = 0;
+        for (std::size_t j = 0; j < N; ++j) rhs[i] += (*a)[i][j] * x[j];
+      }
+      cholesky_solve(*l, rhs);
+      T error = 0;
+      for (std::size_t i = 0; i < N; ++i) error = std::max(error, std::abs(rhs[i] - x[i]));
+      TB_CHECK(error <= T(N) * T(1e3) * std::numeric_limits<T>::epsilon());
+    }
+
+  template<typename T, std::size_t N>
+    void both(std::size_t threads = 0)
+    {
+      lu<T, N>(threads);
+      cholesky<T, N>(threads);
+    }
+
+  // dot, the norms and axpy on float vectors of n elements.
+  template<std::size_t N>
+    void vectors()
+    {
+      std::uint64_t state = 5 * N;
+      multi_array<float, N> x, y;
+      for (std::size_t i = 0; i < N; ++i) x[i] = float(next(state));
+      for (std::size_t i = 0; i < N; ++i) y[i] = float(next(state));
+
+      double xy = 0, xx = 0, abs_sum = 0, abs_max = 0, scale = 0;
+      for (std::size_t i = 0; i < N; ++i) {
+        xy += double(x[i]) * y[i];
+        xx += double(x[i]) * x[i];
+        abs_sum += std::abs(double(x[i]));
+        abs_max = std::max(abs_max, std::abs(double(x[i])));
+        scale += std::abs(double(x[i]) * y[i]);
+      }
+      const double eps = std::numeric_limits<float>::epsilon();
+      TB_CHECK(std::abs(dot(x, y) - xy) <= N * eps * scale);
+      TB_CHECK(std::abs(norm2(x) - std::sqrt(xx)) <= N * eps * std::sqrt(xx));
+      TB_CHECK(std::abs(norm1(x) - abs_sum) <= N * eps * abs_sum);
+      TB_CHECK(norm_inf(x) == float(abs_max));
+
+      // The norms of a matrix are those of its elements.
+      multi_array<float, 2, N> m;
+      m[0] = x;
+      m[1] = y;
+      double mm = xx;
+      for (std::size_t i = 0; i < N; ++i) mm += double(y[i]) * y[i];
+      TB_CHECK(std::abs(norm2(m) - std::sqrt(mm)) <= 2 * N * eps * std::sqrt(mm));
+      TB_CHECK(norm_inf(m) >= norm_inf(x));
+
+      multi_array<float, N> z = y;
+      axpy(0.5f, x, z);
+      bool exact = true;
+      for (std::size_t i = 0; i < N; ++i) exact = exact && z[i] == y[i] + 0.5f * x[i];
+      TB_CHECK(exact);
+      z = x;
+      axpy(0.5f, z, z);  // x and y the same array
+      exact = true;
+      for (std::size_t i = 0; i < N; ++i) exact = exact && z[i] == x[i] + 0.5f * x[i];
+      TB_CHECK(exact);
+    }
+
+  // matvec against the naive product, on one band of rows and on several.
+  template<std::size_t M, std::size_t N>
+    void products()
+    {
+      std::uint64_t state = 7 * M + N;
+      const auto a = std::make_unique<multi_array<double, M, N>>();
+      multi_array<double, N> x;
+      for (std::size_t i = 0; i < M; ++i)
+        for (std::size_t j = 0; j < N; ++j) (*a)[i][j] = next(state);
+      for (std::size_t j = 0; j < N; ++j) x[j] = next(state);
+      multi_array<double, M> expected;
+      for (std::size_t i = 0; i < M; ++i) {
+        expected[i] = 0;
+        for (std::size_t j = 0; j < N; ++j) expected[i] += (*a)[i][j] * x[j];
+      }
+      auto close = [&](const multi_array<double, M>& y) {
+        for (std::size_t i = 0; i < M; ++i)
+          if (std::abs(y[i] - expected[i]) > N * 1e-15) return false;
+        return true;
+      };
+      TB_CHECK(close(matvec(*a, x)));
+      TB_CHECK(close(matvec(*a, x, 1)));
+      multi_array<double, M> y;
+      for (std::size_t parts : { 1, 2, 3, 5 }) {
+        y.fill(-1);
+        matvec_impl(*a, x, y, std::min(parts, M));
+        TB_CHECK(close(y));
+      }
+    }
+
+  void errors()
+  {
+    multi_array<double, 3, 3> singular = { { 1, 2, 3 }, { 2, 4, 6 }, { 0, 0, 1 } };
+    multi_array<std::size_t, 3> p3;
+    TB_CHECK(throws([&] { lu_factor(singular, p3); }));
+    multi_array<double, 3, 3> indefinite = { { 1, 0, 0 }, { 0, -1, 0 }, { 0, 0, 1 } };
+    TB_CHECK(throws([&] { tb::cholesky(indefinite); }));
+
+    static multi_array<double, 20, 20> zero_column{};
+    for (std::size_t i = 0; i < 20; ++i)
+      for (std::size_t j = 1; j < 20; ++j) zero_column[i][j] = double(i == j);
+    multi_array<std::size_t, 20> p20;
+    TB_CHECK(throws([&] { lu_factor(zero_column, p20); }));
+    static multi_array<double, 20, 20> negative{};
+    for (std::size_t i = 0; i < 20; ++i) negative[i][i] = i == 17 ? -1 : 1;
+    TB_CHECK(throws([&] { tb::cholesky(negative); }));
+  }
+
+} // namespace
+
+int main()
+{
+  both<double, 1>();
+  both<double, 2>();
+  both<float, 3>();
+  both<double, 4>();
+  both<double, 8>();
+  both<double, 9>();
+  both<float, 33>();
+  both<double, 65>();
+  both<double, 200>();
+  // Above linalg_parallel_min, on one thread and on several.
+  both<double, 300>(1);
+  both<double, 300>(3);
+  errors();
+  vectors<1>();
+  vectors<5>();
+  vectors<8>();
+  vectors<64>();
+  vectors<67>();
+  products<1, 1>();
+  products<3, 5>();
+  products<37, 67>();
+  products<300, 1000>();
+  return report("linalg_test");
+}
@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+// Memory footprints: the alignment reported is the largest power of two
+// dividing the address, however large, and the cache-line and page spans
+// count every line and page the logical bytes touch.
+//
+//   g++ -std=c++20 -O2 -I src test/memory_test.cpp && ./a.out
+
+#include "multi_array.h"
+#include "multi_array_memory.h"
+#include "test.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  constexpr std::size_t huge = std::size_t{2} << 20;
+
+  void alignments(char* base)
+  {
+    TB_CHECK(footprint(base, 1, 1).alignment >= huge);
+    for (std::size_t a = 1; a < huge; a <<= 1)
+      TB_CHECK(footprint(base + a, 1, 1).alignment == a);
+    TB_CHECK(footprint(base + 3 * 4096, 1, 1).alignment == 4096);
+    TB_CHECK(footprint(base + 12, 1, 1).alignment == 4);
+    TB_CHECK(footprint(nullptr, 0, 0).alignment == 0);
+  }
+
+  void spans(char* base)
+  {
+    auto f = footprint(base, 64, 100);
+    TB_CHECK(f.logical_bytes == 64 && f.allocated_bytes == 100 && f.padding_bytes == 36);
+    TB_CHECK(f.cache_lines == 1 && f.alignment_waste == 0 && f.pages == 1);
+    f = footprint(base + 63, 2, 2);
+    TB_CHECK(f.cache_lines == 2 && f.alignment_waste == 126);
+    f = footprint(base + f.page_size - 1, f.page_size + 2, f.page_size + 2);
+    TB_CHECK(f.pages == 3);
+    TB_CHECK(f.resident_pages <= f.pages);
+    f = footprint(base, 0, 8);
+    TB_CHECK(f.cache_lines == 0 && f.pages == 0 && f.padding_bytes == 8);
+  }
+
+  void arrays()
+  {
+    alignas(4096) static multi_array<double, 8, 8> a;
+    const auto f = footprint(a);
+    TB_CHECK(f.alignment >= 4096);
+    TB_CHECK(f.logical_bytes == sizeof a && f.padding_bytes == 0);
+    TB_CHECK(f.cache_lines == sizeof a / cache_line_size);
+  }
+
+} // namespace
+
+int main()
+{
+  // Two huge pages, the first at a 2 MiB boundary, touched so that they
+  // are mapped.
+  char* base = static_cast<char*>(std::aligned_alloc(huge, 2 * huge));
+  TB_CHECK(base != nullptr);
+  if (!base) return report("memory_test");
+  std::memset(base, 1, 2 * huge);
+
+  alignments(base);
+  spans(base);
+  arrays();
+
+  std::free(base);
+  return report("memory_test");
+}
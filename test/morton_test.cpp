@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Morton codes against a bit-by-bit reference, and the storage order of
+// morton_array for square, cubic and unequal power-of-two shapes.
+//
+//   g++ -std=c++20 -O2 -march=native -I src test/morton_test.cpp && ./a.out
+
+#include "multi_array_morton.h"
+#include "test.h"
+
+#include <cstdint>
+#include <vector>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  // Bit b of coordinate d goes to bit b * rank + d.
+  std::uint64_t reference_encode(const std::uint32_t* x, unsigned rank, unsigned bits)
+  {
+    std::uint64_t code = 0;
+    for (unsigned b = 0; b < bits; ++b)
+      for (unsigned d = 0; d < rank; ++d)
+        code |= std::uint64_t{x[d] >> b & 1} << (b * rank + d);
+    return code;
+  }
+
+  // Deterministic pseudo-random values.
+  std::uint32_t next(std::uint64_t& state)
+  {
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    return static_cast<std::uint32_t>(state >> 32);
+  }
+
+  void codes()
+  {
+    static_assert(morton_encode(0, 0) == 0 && morton_encode(1, 0) == 1
+                  && morton_encode(0, 1) == 2 && morton_encode(1, 1) == 3);
+    static_assert(morton_encode(1, 0, 0) == 1 && morton_encode(0, 1, 0) == 2
+                  && morton_encode(0, 0, 1) == 4);
+    static_assert(morton_decode2(morton_encode(123, 456))[1] == 456);
+
+    std::uint64_t state = 1;
+    for (int n = 0; n < 100000; ++n) {
+      std::uint32_t x[2] = { next(state), next(state) };
+      if (n == 0) x[0] = x[1] = 0xFFFFFFFFu;
+      const std::uint64_t code = morton_encode(x[0], x[1]);
+      TB_CHECK(code == reference_encode(x, 2, 32));
+      const auto back = morton_decode2(code);
+      TB_CHECK(back[0] == x[0] && back[1] == x[1]);
+
+      std::uint32_t y[3] = { next(state) >> 11, next(state) >> 11, next(state) >> 11 };
+      if (n == 0) y[0] = y[1] = y[2] = 0x1FFFFF;
+      const std::uint64_t code3 = morton_encode(y[0], y[1], y[2]);
+      TB_CHECK(code3 == reference_encode(y, 3, 21));
+      const auto back3 = morton_decode3(code3);
+      TB_CHECK(back3[0] == y[0] && back3[1] == y[1] && back3[2] == y[2]);
+
+      const std::uint64_t mask = std::uint64_t{next(state)} << 32 | next(state);
+      const std::uint64_t bits = std::uint64_t{next(state)} << 32 | next(state);
+      TB_CHECK(morton_extract_impl(morton_deposit_impl(bits, mask), mask)
+               == (bits & ((std::uint64_t{1} << std::popcount(mask)) - 1)));
+    }
+  }
+
+  // Every element of a morton_array has its own storage index, and row-major
+  // arrays convert to and from it unchanged.
+  template<std::size_t... E>
+    void storage()
+    {
+      using M = morton_array<int, E...>;
+      constexpr std::size_t e[] = { E... };
+      std::vector<int> seen(M::total_size(), 0);
+      multi_array<int, E...> a;
+      int value = 0;
+      if constexpr (sizeof...(E) == 2) {
+        for (std::size_t i = 0; i < e[0]; ++i)
+          for (std::size_t j = 0; j < e[1]; ++j) {
+            const auto k = M::index(i, j);
+            TB_CHECK(k < M::total_size());
+            if (k < M::total_size()) ++seen[k];
+            a[i][j] = value++;
+          }
+      } else {
+        for (std::size_t i = 0; i < e[0]; ++i)
+          for (std::size_t j = 0; j < e[1]; ++j)
+            for (std::size_t k = 0; k < e[2]; ++k) {
+              const auto s = M::index(i, j, k);
+              TB_CHECK(s < M::total_size());
+              if (s < M::total_size()) ++seen[s];
+              a[i][j][k] = value++;
+            }
+      }
+      for (int count : seen) TB_CHECK(count == 1);
+      const M m = to_morton(a);
+      TB_CHECK(to_multi_array(m) == a);
+    }
+
+  // Square grids are stored in Z order: a(i, j) at morton_encode(j, i).
+  void z_order()
+  {
+    multi_array<int, 8, 8> a;
+    for (std::size_t i = 0; i < 8; ++i)
+      for (std::size_t j = 0; j < 8; ++j) a[i][j] = int(i * 8 + j);
+    const auto m = to_morton(a);
+    std::uint64_t k = 0;
+    for (int v : m) {
+      const auto [j, i] = morton_decode2(k++);
+      TB_CHECK(v == int(i * 8 + j));
+    }
+    TB_CHECK(m.data()[0] == 0 && m.data()[1] == 1 && m.data()[2] == 8 && m.data()[3] == 9);
+    TB_CHECK((morton_array<int, 4, 16>::index(1, 0) == 2));
+    TB_CHECK((morton_array<int, 4, 16>::index(0, 4) == 16));
+  }
+
+} // namespace
+
+int main()
+{
+  codes();
+  storage<8, 8>();
+  storage<4, 16>();
+  storage<16, 2>();
+  storage<1, 8>();
+  storage<4, 4, 4>();
+  storage<2, 4, 8>();
+  storage<8, 1, 2>();
+  z_order();
+  return report("morton_test");
+}
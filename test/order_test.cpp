@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Traversal orders: every order visits each element exactly once, Z-order
+// follows the Morton codes, and Hilbert order moves to a neighbouring
+// element at every step on power-of-two squares and cubes.
+//
+//   g++ -std=c++20 -O2 -I src test/order_test.cpp && ./a.out
+
+#include "multi_array_order.h"
+#include "test.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  using point = std::array<std::size_t, 3>;
+
+  // The indices visited by for_each(a, o, f), in order.
+  template<typename A>
+    std::vector<point> visits(A& a, order o)
+    {
+      std::vector<point> path;
+      bool same = true;
+      for_each(a, o, [&](auto& x, auto... i) {
+        same = same && &x == &a(i...);
+        const std::size_t index[] = { i... };
+        point p{};
+        std::copy(std::begin(index), std::end(index), p.begin());
+        path.push_back(p);
+      });
+      TB_CHECK(same);
+      return path;
+    }
+
+  template<typename A>
+    void covers(A& a, order o)
+    {
+      constexpr auto e = multi_array_extents_v<A>;
+      std::vector<int> seen(A::total_size(), 0);
+      for (const point& p : visits(a, o)) {
+        std::size_t flat = 0;
+        for (std::size_t d = 0; d < e.size(); ++d) flat = flat * e[d] + p[d];
+        ++seen[flat];
+      }
+      for (int count : seen) TB_CHECK(count == 1);
+    }
+
+  template<typename A>
+    void covers(A& a)
+    {
+      covers(a, order::row_major);
+      covers(a, order::morton);
+      covers(a, order::hilbert);
+    }
+
+  template<typename A>
+    void hilbert_is_continuous(A& a)
+    {
+      const auto path = visits(a, order::hilbert);
+      TB_CHECK(path.front() == point{});
+      for (std::size_t n = 1; n < path.size(); ++n) {
+        std::size_t distance = 0;
+        for (std::size_t d = 0; d < 3; ++d)
+          distance += path[n][d] > path[n - 1][d] ? path[n][d] - path[n - 1][d]
+                                                  : path[n - 1][d] - path[n][d];
+        TB_CHECK(distance == 1);
+      }
+    }
+
+  void orders()
+  {
+    static multi_array<int, 16, 16> square{};
+    auto path = visits(square, order::row_major);
+    for (std::size_t n = 0; n < path.size(); ++n)
+      TB_CHECK((path[n] == point{ n / 16, n % 16, 0 }));
+
+    path = visits(square, order::morton);
+    for (std::size_t n = 0; n < path.size(); ++n) {
+      const auto [j, i] = morton_decode2(n);
+      TB_CHECK((path[n] == point{ i, j, 0 }));
+    }
+
+    static multi_array<int, 8, 8, 8> cube{};
+    path = visits(cube, order::morton);
+    for (std::size_t n = 0; n < path.size(); ++n) {
+      const auto [k, j, i] = morton_decode3(n);
+      TB_CHECK((path[n] == point{ i, j, k }));
+    }
+  }
+
+  // f(element) alone, on a const array and during constant evaluation.
+  constexpr int sum_in_hilbert_order()
+  {
+    multi_array<int, 3, 5> a;
+    int n = 0;
+    for_each(a, order::hilbert, [&](int& x) { x = n++; });
+    const multi_array<int, 3, 5>& c = a;
+    int sum = 0;
+    for_each(c, order::morton, [&](const int& x) { sum += x; });
+    return sum;
+  }
+  static_assert(sum_in_hilbert_order() == 14 * 15 / 2);
+
+} // namespace
+
+int main()
+{
+  static multi_array<float, 64, 64> square;
+  static multi_array<float, 50, 70> wide;
+  static multi_array<float, 70, 3> tall;
+  static multi_array<int, 16, 16, 16> cube;
+  static multi_array<int, 5, 7, 9> odd;
+  static multi_array<int, 1, 1> one;
+  covers(square);
+  covers(wide);
+  covers(tall);
+  covers(cube);
+  covers(odd);
+  covers(one);
+  hilbert_is_continuous(square);
+  hilbert_is_continuous(cube);
+  static multi_array<float, 32, 64> two_squares;
+  covers(two_squares);
+  orders();
+  return report("order_test");
+}
@@ -0,0 +1,191 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+
+// Prefetching walks: for_each_strided, for_each_in_column,
+// for_each_column_major and gather visit the same elements in the same
+// order whatever the prefetch distance, whether it is 0, at least the
+// length of the walk, or in between, and with either prefetch intent.
+//
+//   g++ -std=c++20 -O2 -I src test/prefetch_test.cpp && ./a.out
+
+#include "multi_array_prefetch.h"
+#include "test.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  // Distances the tune cache below sets for page-sized and shorter strides.
+  constexpr std::size_t near = 3;
+  constexpr std::size_t far = 5;
+
+  // Walks n elements of 0, 1, 2, ... stride apart from element start, with
+  // every distance from 0 to beyond n.
+  void strided(std::size_t n, std::ptrdiff_t stride, std::size_t start)
+  {
+    std::vector<int> v(start + n * (stride < 0 ? -stride : stride) + 1);
+    std::iota(v.begin(), v.end(), 0);
+    std::vector<int> expected;
+    for (std::size_t k = 0; k < n; ++k)
+      expected.push_back(static_cast<int>(start + static_cast<std::ptrdiff_t>(k) * stride));
+    for (std::size_t d = 0; d <= n + 2; ++d) {
+      std::vector<int> seen;
+      const int* first = v.data() + start;
+      for_each_strided(first, n, stride, [&](const int& x) { seen.push_back(x); }, d);
+      TB_CHECK(seen == expected);
+      // Writes through a write-intent walk reach exactly the visited elements.
+      std::vector<int> w(v.size());
+      for_each_strided<prefetch_intent::write>(w.data() + start, n, stride,
+                                               [](int& x) { ++x; }, d);
+      int hits = 0;
+      for (int e : expected) hits += w[e];
+      TB_CHECK(hits == static_cast<int>(n));
+      TB_CHECK(std::accumulate(w.begin(), w.end(), 0) == static_cast<int>(n));
+    }
+  }
+
+  // The tuned overload, with strides that select no distance, near and far.
+  void strided_tuned()
+  {
+    for (std::ptrdiff_t stride : { 1, 16, -16, 1024, -1024 })
+      for (std::size_t n : { std::size_t{0}, std::size_t{1}, near, near + 1, far, far + 1, std::size_t{40} }) {
+        const std::size_t start = stride < 0 ? n * -stride : 0;
+        std::vector<int> v(start + n * (stride < 0 ? -stride : stride) + 1);
+        std::iota(v.begin(), v.end(), 0);
+        std::vector<int> seen;
+        for_each_strided(v.data() + start, n, stride, [&](int x) { seen.push_back(x); });
+        bool ok = seen.size() == n;
+        for (std::size_t k = 0; ok && k < n; ++k)
+          ok = seen[k] == static_cast<int>(start + static_cast<std::ptrdiff_t>(k) * stride);
+        TB_CHECK(ok);
+      }
+  }
+
+  // Column walks over an R x C array of 0, 1, 2, ... in row-major order.
+  template<std::size_t R, std::size_t C>
+    void columns()
+    {
+      static multi_array<int, R, C> a;
+      std::iota(a.data(), a.data() + R * C, 0);
+      const auto& ca = a;
+
+      for (std::size_t j = 0; j < C; j += C > 4 ? C / 4 : 1) {
+        std::vector<int> seen;
+        for_each_in_column(ca, j, [&](int x) { seen.push_back(x); });
+        bool ok = seen.size() == R;
+        for (std::size_t i = 0; ok && i < R; ++i) ok = seen[i] == static_cast<int>(i * C + j);
+        TB_CHECK(ok);
+      }
+
+      // Indices and values in column-major order.
+      std::size_t k = 0;
+      bool ok = true;
+      for_each_column_major(ca, [&](const int& x, std::size_t i, std::size_t j) {
+        ok = ok && i == k % R && j == k / R && x == static_cast<int>(i * C + j);
+        ++k;
+      });
+      TB_CHECK(ok && k == R * C);
+
+      // Without indices, and writing every element once.
+      std::vector<int> seen;
+      for_each_column_major(ca, [&](int x) { seen.push_back(x); });
+      ok = seen.size() == R * C;
+      for (std::size_t n = 0; ok && n < seen.size(); ++n)
+        ok = seen[n] == static_cast<int>(n % R * C + n / R);
+      TB_CHECK(ok);
+
+      for_each_column_major<prefetch_intent::write>(a, [](int& x, std::size_t i, std::size_t j) {
+        x -= static_cast<int>(i * C + j) - 1;
+      });
+      TB_CHECK(std::all_of(a.data(), a.data() + R * C, [](int x) { return x == 1; }));
+      for_each_in_column<prefetch_intent::write>(a, C - 1, [](int& x) { x = 2; });
+      ok = true;
+      for (std::size_t i = 0; i < R; ++i)
+        for (std::size_t j = 0; j < C; ++j) ok = ok && a[i][j] == (j == C - 1 ? 2 : 1);
+      TB_CHECK(ok);
+    }
+
+  // Gathers of n offsets, shorter than, as long as and longer than the far
+  // distance, with repeats and descending runs.
+  void gathers(std::size_t n)
+  {
+    static multi_array<int, 64, 1024> a;
+    std::iota(a.data(), a.data() + a.total_size(), 0);
+    std::vector<std::size_t> offsets(n);
+    for (std::size_t k = 0; k < n; ++k)
+      offsets[k] = k % 3 == 2 ? offsets[k - 1] : (k * 40503 + 17) % a.total_size();
+    std::vector<int> out(n + 1, -1);
+    auto end = gather(a, offsets, out.begin());
+    TB_CHECK(end == out.begin() + static_cast<std::ptrdiff_t>(n));
+    bool ok = out[n] == -1;
+    for (std::size_t k = 0; ok && k < n; ++k) ok = out[k] == static_cast<int>(offsets[k]);
+    TB_CHECK(ok);
+  }
+
+} // namespace
+
+int main()
+{
+  // Fixed distances, read by prefetch_distance on first use.
+  const temp_file cache("prefetch_tune.txt");
+  if (std::FILE* f = std::fopen(cache.path.string().c_str(), "w")) {
+    std::fprintf(f, "%s\tprefetch.near\t%zu\n", cpu_model().c_str(), near);
+    std::fprintf(f, "%s\tprefetch.far\t%zu\n", cpu_model().c_str(), far);
+    std::fclose(f);
+  }
+  ::setenv("TB_MULTI_ARRAY_TUNE_CACHE", cache.path.string().c_str(), 1);
+  TB_CHECK(prefetch_distance(sizeof(int)) == 0);
+  TB_CHECK(prefetch_distance(prefetch_min_stride) == near);
+  TB_CHECK(prefetch_distance(prefetch_far_stride) == far);
+
+  for (std::size_t n : { 0, 1, 2, 7, 20 }) {
+    strided(n, 1, 0);
+    strided(n, 5, 3);
+    strided(n, 300, 0);
+    strided(n, -7, n * 7);
+  }
+  strided_tuned();
+
+  // Rows shorter than, equal to and longer than the distances.
+  columns<3, 3>();
+  columns<1, 16>();
+  columns<3, 16>();
+  columns<4, 16>();
+  columns<10, 17>();
+  columns<5, 1024>();
+  columns<6, 1024>();
+  columns<33, 1030>();
+
+  for (std::size_t n : { 0, 1, 4, 5, 6, 7, 100 }) gathers(n);
+
+  return report("prefetch_test");
+}
@@ -0,0 +1,146 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Trivial copies and relocation: arrays of trivial elements are trivial
+// and unpadded for any shape, and arrays of elements that are trivially
+// relocatable without being trivially copyable are swapped by bytes,
+// without moving, copying or destroying a single element.
+//
+//   g++ -std=c++20 -O2 -pthread -I src test/relocate_test.cpp && ./a.out
+
+#include "multi_array_stream.h"
+#include "test.h"
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  // Holds a unique_ptr, so it is neither copyable nor trivially copyable,
+  // and counts the moves and destructions of non-empty handles.
+  struct handle {
+    static inline int moves = 0;
+    static inline int destroyed = 0;
+
+    handle() = default;
+    explicit handle(int v) : p(std::make_unique<int>(v)) {}
+    handle(handle&& h) noexcept : p(std::move(h.p)) { ++moves; }
+    handle& operator=(handle&& h) noexcept { p = std::move(h.p); ++moves; return *this; }
+    ~handle() { if (p) ++destroyed; }
+
+    std::unique_ptr<int> p;
+  };
+
+  struct padded {
+    double d;
+    char c;
+  };
+
+} // namespace
+
+template<>
+  struct tb::is_trivially_relocatable<handle> : std::true_type {};
+
+namespace {
+
+  template<typename A>
+    constexpr bool trivial_array = std::is_trivial_v<A> && std::is_standard_layout_v<A>
+                                   && is_trivially_relocatable_v<A>
+                                   && sizeof(A) == sizeof(typename A::element_type) * A::total_size();
+
+  static_assert(trivial_array<multi_array<char, 3>>);
+  static_assert(trivial_array<multi_array<padded, 3, 5>>);
+  static_assert(trivial_array<multi_array<padded, 2, 3, 5, 7>>);
+  static_assert(trivial_array<multi_array<long double, 1, 1>>);
+  static_assert(trivial_array<multi_array<multi_array<short, 3>, 4, 2>>);
+  static_assert(!std::is_trivially_copyable_v<multi_array<handle, 4>>);
+  static_assert(is_trivially_relocatable_v<multi_array<handle, 4, 4>>);
+  static_assert(std::is_nothrow_move_constructible_v<multi_array<handle, 3, 3>>);
+
+  template<typename A>
+    void make(A& a, int first)
+    {
+      for (std::size_t k = 0; k < A::total_size(); ++k)
+        a.data()[k] = handle(first + int(k));
+    }
+
+  // The ints each handle points to, in order.
+  template<typename A>
+    bool holds(const A& a, const int* const* expected, int first)
+    {
+      for (std::size_t k = 0; k < A::total_size(); ++k)
+        if (a.data()[k].p.get() != expected[k] || *a.data()[k].p != first + int(k))
+          return false;
+      return true;
+    }
+
+  // swap and stream_swap exchange the handles themselves, a block of
+  // swap_bytes_impl's 256-byte buffer or a 16-byte line at a time.
+  template<typename A>
+    void swaps()
+    {
+      static A a, b;
+      make(a, 0);
+      make(b, 1000);
+      std::unique_ptr<const int*[]> pa(new const int*[A::total_size()]);
+      std::unique_ptr<const int*[]> pb(new const int*[A::total_size()]);
+      for (std::size_t k = 0; k < A::total_size(); ++k) {
+        pa[k] = a.data()[k].p.get();
+        pb[k] = b.data()[k].p.get();
+      }
+      handle::moves = handle::destroyed = 0;
+
+      a.swap(b);
+      TB_CHECK(holds(a, pb.get(), 1000) && holds(b, pa.get(), 0));
+      a.swap(a);
+      TB_CHECK(holds(a, pb.get(), 1000));
+      using std::swap;
+      swap(a, b);
+      TB_CHECK(holds(a, pa.get(), 0) && holds(b, pb.get(), 1000));
+
+      set_stream_threshold(1);
+      a.swap(b);
+      TB_CHECK(holds(a, pb.get(), 1000) && holds(b, pa.get(), 0));
+      stream_swap(a, b, 3);
+      TB_CHECK(holds(a, pa.get(), 0) && holds(b, pb.get(), 1000));
+      set_stream_threshold(llc_size());
+
+      TB_CHECK(handle::moves == 0 && handle::destroyed == 0);
+    }
+
+} // namespace
+
+int main()
+{
+  swaps<multi_array<handle, 17>>();       // 136 bytes, one block
+  swaps<multi_array<handle, 32>>();       // exactly one block
+  swaps<multi_array<handle, 33>>();       // one block and a tail
+  swaps<multi_array<handle, 4, 25>>();    // 800 bytes, three blocks and a tail
+  swaps<multi_array<handle, 3, 3, 70>>();
+  return report("relocate_test");
+}
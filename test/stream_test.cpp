@@ -0,0 +1,232 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Streaming copy, fill and swap: the non-temporal kernels against memcpy,
+// fill and swap_ranges for every length and alignment of a few vectors,
+// and the streaming functions and member fill and swap against plain
+// loops, on one thread and on several.
+//
+//   g++ -std=c++20 -O2 -pthread -I src test/stream_test.cpp && ./a.out
+
+#include "multi_array_stream.h"
+#include "test.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  unsigned char byte(std::size_t k) { return static_cast<unsigned char>(k * 37 + 11); }
+
+  // Lengths up to 200 bytes from every offset in a 16-byte line, so that
+  // heads, 64-byte blocks, 16-byte steps and tails all occur.
+  void copy_kernel()
+  {
+    alignas(64) char src[256], dst[256], expected[256];
+    for (std::size_t k = 0; k < sizeof src; ++k) src[k] = static_cast<char>(byte(k));
+    bool same = true;
+    for (std::size_t s = 0; s < 16; ++s)
+      for (std::size_t d = 0; d < 16; ++d)
+        for (std::size_t n = 0; n <= 200; n += n < 40 ? 1 : 13) {
+          std::memset(dst, 0, sizeof dst);
+          std::memset(expected, 0, sizeof expected);
+          std::memcpy(expected + d, src + s, n);
+          stream_copy_bytes_impl(dst + d, src + s, n);
+          same = same && std::memcmp(dst, expected, sizeof dst) == 0;
+        }
+    TB_CHECK(same);
+  }
+
+  template<typename T>
+    void fill_kernel(T value)
+    {
+      alignas(64) T a[80], expected[80];
+      bool same = true;
+      for (std::size_t first = 0; first < 16; ++first)
+        for (std::size_t n = 0; first + n <= 64; ++n) {
+          std::fill_n(a, 80, T());
+          std::fill_n(expected, 80, T());
+          std::fill_n(expected + first, n, value);
+          stream_fill_impl(a + first, n, value);
+          same = same && std::equal(a, a + 80, expected);
+        }
+      TB_CHECK(same);
+    }
+
+  // Three bytes: not a divisor of 16, so filled element by element.
+  struct rgb {
+    rgb() = default;
+    constexpr rgb(unsigned char v) noexcept
+      : r(v), g(static_cast<unsigned char>(v + 1)), b(static_cast<unsigned char>(v + 2)) {}
+
+    unsigned char r, g, b;
+    friend bool operator==(const rgb&, const rgb&) = default;
+  };
+
+  void swap_kernel()
+  {
+    alignas(64) char a[256], b[256], x[256], y[256];
+    bool same = true;
+    for (std::size_t oa = 0; oa < 16; ++oa)
+      for (std::size_t ob : { oa, (oa + 5) % 16 })  // equal and unequal alignment
+        for (std::size_t n = 0; n <= 150; n += n < 40 ? 1 : 11) {
+          for (std::size_t k = 0; k < 256; ++k) {
+            a[k] = x[k] = static_cast<char>(byte(k));
+            b[k] = y[k] = static_cast<char>(~byte(k));
+          }
+          std::swap_ranges(x + oa, x + oa + n, y + ob);
+          stream_swap_bytes_impl(a + oa, b + ob, n);
+          same = same && std::memcmp(a, x, 256) == 0 && std::memcmp(b, y, 256) == 0;
+        }
+    TB_CHECK(same);
+  }
+
+  template<typename A>
+    void set(A& a, std::size_t seed)
+    {
+      auto* p = a.data();
+      for (std::size_t k = 0; k < A::total_size(); ++k)
+        p[k] = static_cast<typename A::element_type>(byte(k + seed));
+    }
+
+  template<typename A>
+    bool equal(const A& a, const A& b)
+    { return std::equal(a.data(), a.data() + A::total_size(), b.data()); }
+
+  // The streaming functions and members, with the threshold below and
+  // above the size of A.
+  template<typename A>
+    void arrays()
+    {
+      using T = typename A::element_type;
+      static A a, b, x, y;
+      for (std::size_t threshold : { std::size_t{1}, sizeof(A), sizeof(A) + 1 }) {
+        set_stream_threshold(threshold);
+        for (std::size_t threads : { 1, 3, 0 }) {
+          set(a, 1);
+          set(b, 2);
+          x = a;
+          TB_CHECK(equal(x, a));
+          stream_copy(b, a, threads);
+          TB_CHECK(equal(b, x));
+          stream_copy(b, b, threads);
+          TB_CHECK(equal(b, x));
+
+          set(a, 3);
+          stream_fill(a, T(7), threads);
+          bool filled = std::all_of(a.data(), a.data() + A::total_size(),
+                                    [](const T& v) { return v == T(7); });
+          TB_CHECK(filled);
+
+          set(a, 4);
+          set(b, 5);
+          x = a;
+          y = b;
+          stream_swap(a, b, threads);
+          TB_CHECK(equal(a, y) && equal(b, x));
+          stream_swap(a, a, threads);
+          TB_CHECK(equal(a, y));
+        }
+
+        set(a, 6);
+        a.fill(T(9));
+        TB_CHECK(std::all_of(a.data(), a.data() + A::total_size(),
+                             [](const T& v) { return v == T(9); }));
+        set(a, 7);
+        set(b, 8);
+        x = a;
+        y = b;
+        a.swap(b);
+        TB_CHECK(equal(a, y) && equal(b, x));
+        a.swap(a);
+        TB_CHECK(equal(a, y));
+      }
+      set_stream_threshold(llc_size());
+    }
+
+  // Rows of 1001 bytes start 1001 bytes apart, so member fill and swap on
+  // them start and end off every 16-byte boundary.
+  void unaligned_rows()
+  {
+    static multi_array<char, 4, 1001> a, b, x, y;
+    set_stream_threshold(1);
+    for (std::size_t i = 0; i < 4; ++i) {
+      set(a, i);
+      x = a;
+      a[i].fill('z');
+      std::fill_n(x[i].data(), 1001, 'z');
+      TB_CHECK(equal(a, x));
+      for (std::size_t j = 0; j < 4; ++j) {
+        set(a, i);
+        set(b, j + 9);
+        x = a;
+        y = b;
+        a[i].swap(b[j]);
+        std::swap_ranges(x[i].data(), x[i].data() + 1001, y[j].data());
+        TB_CHECK(equal(a, x) && equal(b, y));
+      }
+    }
+    set_stream_threshold(llc_size());
+  }
+
+} // namespace
+
+int main()
+{
+  // Split even small arrays between threads; the piece size is read from
+  // the tuning cache on first use.
+  const temp_file cache("stream_tune.txt");
+  if (std::FILE* f = std::fopen(cache.path.string().c_str(), "w")) {
+    std::fprintf(f, "%s\tstream.min_chunk\t1000\n", cpu_model().c_str());
+    std::fclose(f);
+  }
+  ::setenv("TB_MULTI_ARRAY_TUNE_CACHE", cache.path.string().c_str(), 1);
+  TB_CHECK(stream_chunk_size() == 1000);
+
+  TB_CHECK(stream_threshold() == llc_size());
+  TB_CHECK(llc_size() >= std::size_t{256} << 10);
+
+  copy_kernel();
+  fill_kernel<char>('x');
+  fill_kernel<std::uint16_t>(0xbeef);
+  fill_kernel<float>(1.5f);
+  fill_kernel<double>(-2.25);
+  fill_kernel<std::uint64_t>(0x0123456789abcdef);
+  fill_kernel(rgb(1));
+  swap_kernel();
+
+  arrays<multi_array<double, 1000, 3>>();
+  arrays<multi_array<char, 1001>>();
+  arrays<multi_array<std::int16_t, 37, 19>>();
+  arrays<multi_array<rgb, 5, 333>>();
+  arrays<multi_array<float, 17>>();  // unrolled members
+  unaligned_rows();
+  return report("stream_test");
+}
@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Minimal test harness used by the programs in test/. Each program checks
+// conditions with TB_CHECK and returns tb::test::report() from main.
+
+#ifndef TB_TEST_H
+#define TB_TEST_H
+
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+namespace tb::test {
+
+  inline int& failures()
+  {
+    static int count = 0;
+    return count;
+  }
+
+  inline void check(bool ok, const char* expression, const char* file, int line)
+  {
+    if (ok) return;
+    ++failures();
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+  }
+
+  // True if f() throws a std::exception.
+  template<typename F>
+    bool throws(F f)
+    {
+      try { f(); } catch (const std::exception&) { return true; }
+      return false;
+    }
+
+  // Prints a summary; the result is the exit status of the program.
+  inline int report(const char* name)
+  {
+    std::printf("%s: %s\n", name, failures() ? "FAILED" : "ok");
+    return failures() ? 1 : 0;
+  }
+
+  // A path in the temporary directory, removed on destruction.
+  struct temp_file {
+    explicit temp_file(const std::string& name)
+      : path(std::filesystem::temp_directory_path() / ("tb_test_" + name)) {}
+
+    temp_file(const temp_file&) = delete;
+    temp_file& operator=(const temp_file&) = delete;
+
+    ~temp_file()
+    {
+      std::error_code ignored;
+      std::filesystem::remove(path, ignored);
+    }
+
+    const std::filesystem::path path;
+  };
+
+} // namespace tb::test
+
+#define TB_CHECK(...) \
+  ::tb::test::check(static_cast<bool>(__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
+
+#endif//TB_TEST_H
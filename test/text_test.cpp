@@ -0,0 +1,276 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Delimited text loading: fixed shapes and run-time tables, line endings
+// and blank lines, malformed input, and files split between threads.
+// Formatting: exact to_string, operator<< and std::format output, in full
+// and summarized, on one thread and on several.
+//
+//   g++ -std=c++20 -O2 -pthread -I src test/text_test.cpp && ./a.out
+
+#include "multi_array_text.h"
+#include "test.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  void write(const temp_file& file, const std::string& text)
+  {
+    std::FILE* f = std::fopen(file.path.string().c_str(), "wb");
+    std::fwrite(text.data(), 1, text.size(), f);
+    std::fclose(f);
+  }
+
+  template<typename A>
+    A load(const std::string& text, char delim = ',')
+    {
+      const temp_file file("text.txt");
+      write(file, text);
+      return load_text<A>(file.path, delim);
+    }
+
+  template<typename T>
+    text_table<T> table(const std::string& text, char delim = ',')
+    {
+      const temp_file file("table.txt");
+      write(file, text);
+      return load_text<T>(file.path, delim);
+    }
+
+  template<typename A>
+    bool fails(const std::string& text, char delim = ',')
+    { return throws([&] { load<A>(text, delim); }); }
+
+  void shapes()
+  {
+    using m23 = multi_array<double, 2, 3>;
+    TB_CHECK((load<m23>("1,2,3\n4,5,6.5\n") == m23{ { 1, 2, 3 }, { 4, 5, 6.5 } }));
+    TB_CHECK((load<multi_array<int, 4>>("1, -2 ,3,\t4\n") == multi_array<int, 4>{ 1, -2, 3, 4 }));
+
+    // Outer dimensions are read row-major, one innermost row per line.
+    const auto a = load<multi_array<int, 2, 2, 3>>("0,1,2\n3,4,5\n6,7,8\n9,10,11\n");
+    bool ordered = true;
+    for (int k = 0; k < 12; ++k) ordered = ordered && a.data()[k] == k;
+    TB_CHECK(ordered);
+
+    // Blank delimiters: any run of blanks separates fields.
+    TB_CHECK((load<m23>("1 2  3\n\t4\t5 6\n", ' ') == m23{ { 1, 2, 3 }, { 4, 5, 6 } }));
+    TB_CHECK((load<m23>("1\t2\t3\n4\t5\t6\n", '\t') == m23{ { 1, 2, 3 }, { 4, 5, 6 } }));
+    TB_CHECK((load<m23>("1;2;3\n4;5;6\n", ';') == m23{ { 1, 2, 3 }, { 4, 5, 6 } }));
+  }
+
+  void line_endings()
+  {
+    using m23 = multi_array<int, 2, 3>;
+    const m23 expected{ { 1, 2, 3 }, { 4, 5, 6 } };
+    TB_CHECK(load<m23>("1,2,3\r\n4,5,6\r\n") == expected);
+    TB_CHECK(load<m23>("1,2,3\n4,5,6") == expected);          // no final newline
+    TB_CHECK(load<m23>("1,2,3\r\n4,5,6") == expected);
+    TB_CHECK(load<m23>("\n\n1,2,3\n\n \t\r\n4,5,6\n\n") == expected);
+    TB_CHECK(load<m23>("  1 ,2, 3  \n4,5 ,6\r\n   \n") == expected);
+
+    const auto t = table<double>("\r\n1.5,2\r\n\r\n3,4\r\n5,6");
+    TB_CHECK(t.rows == 3 && t.columns == 2);
+    TB_CHECK((t.values == std::vector<double>{ 1.5, 2, 3, 4, 5, 6 }));
+    TB_CHECK(t(2, 1) == 6);
+
+    const auto empty = table<int>("");
+    TB_CHECK(empty.rows == 0 && empty.columns == 0 && empty.values.empty());
+    const auto blank = table<int>("\n  \r\n\n");
+    TB_CHECK(blank.rows == 0 && blank.columns == 0);
+    const auto one = table<int>("7");
+    TB_CHECK(one.rows == 1 && one.columns == 1 && one(0, 0) == 7);
+  }
+
+  void errors()
+  {
+    using m23 = multi_array<int, 2, 3>;
+    TB_CHECK(fails<m23>("1,2,3\n4,x,6\n"));      // malformed number
+    TB_CHECK(fails<m23>("1,2,3\n4,,6\n"));       // empty field
+    TB_CHECK(fails<m23>("1,2,3\n4,5,6,\n"));     // trailing delimiter
+    TB_CHECK(fails<m23>("1,2,3\n4 5,6\n"));      // missing delimiter
+    TB_CHECK(fails<m23>("1,2,3\n4,5,6.5\n"));    // not an integer
+    TB_CHECK(fails<m23>("1,2,3\n4,5,99999999999\n"));
+    TB_CHECK(fails<m23>("1,2,3\n4,5,6,7\n"));    // too many columns
+    TB_CHECK(fails<m23>("1,2,3\n4,5\n"));        // too few columns
+    TB_CHECK(fails<m23>("1,2,3\n4,5,6\n7,8,9\n"));  // too many rows
+    TB_CHECK(fails<m23>("1,2,3\n"));              // too few rows
+    TB_CHECK(fails<m23>(""));
+    TB_CHECK(throws([] { table<int>("1,2\n3,4,5\n"); }));
+    TB_CHECK(throws([] { table<int>("1,2\n3\n"); }));
+    TB_CHECK(throws([] { table<double>("1,2\nnan?,4\n"); }));
+    TB_CHECK(throws([] { load_text<m23>("/nonexistent/tb_test_missing.txt"); }));
+    TB_CHECK(throws([] { load_text<int>("/nonexistent/tb_test_missing.txt"); }));
+  }
+
+  // Row i of the large input: "i,i+1,...", with CRLF and blank lines
+  // scattered through it so that they also fall on split points.
+  std::string large_input(std::size_t rows, std::size_t cols)
+  {
+    std::string text;
+    for (std::size_t i = 0; i < rows; ++i) {
+      for (std::size_t j = 0; j < cols; ++j)
+        text += std::to_string(i * cols + j) + (j + 1 < cols ? "," : "");
+      text += i % 7 == 0 ? "\r\n" : "\n";
+      if (i % 13 == 0) text += "\n";
+      if (i % 29 == 0) text += " \t\n";
+    }
+    return text;
+  }
+
+  void large()
+  {
+    constexpr std::size_t rows = 3000, cols = 8;
+    const std::string text = large_input(rows, cols);
+    using A = multi_array<int, rows, cols>;
+    static A a;
+    a = load<A>(text);
+    bool values = true;
+    for (std::size_t k = 0; k < rows * cols; ++k) values = values && a.data()[k] == int(k);
+    TB_CHECK(values);
+
+    const auto t = table<int>(text);
+    TB_CHECK(t.rows == rows && t.columns == cols);
+    TB_CHECK(std::equal(t.values.begin(), t.values.end(), a.data()));
+
+    // Every split gives the same rows; pieces start on line boundaries.
+    for (std::size_t threads : { 1, 2, 3, 7, 64 }) {
+      const auto bounds = split_text_lines_impl(text.data(), text.data() + text.size(), threads);
+      bool lines = bounds.front() == text.data() && bounds.back() == text.data() + text.size()
+                   && bounds.size() <= threads + 1;
+      for (std::size_t b = 1; b + 1 < bounds.size(); ++b)
+        lines = lines && bounds[b] > bounds[b - 1] && bounds[b][-1] == '\n';
+      TB_CHECK(lines);
+      std::vector<int> values;
+      TB_CHECK(parse_text_impl<int>(text.data(), text.data() + text.size(), ',', cols, 0,
+                                    &values, nullptr, threads) == rows);
+      TB_CHECK(values == t.values);
+    }
+
+    // Errors in any piece are reported.
+    std::string bad = text;
+    bad[bad.size() * 3 / 4] = 'x';
+    TB_CHECK(throws([&] { load<A>(bad); }));
+    TB_CHECK(throws([&] { table<int>(bad); }));
+    TB_CHECK(throws([&] { load<A>(text + "1,2,3,4,5,6,7,8\n"); }));
+  }
+
+  void formatting()
+  {
+    TB_CHECK(to_string(multi_array<int, 3>{ 1, -2, 3 }) == "[1, -2, 3]");
+    TB_CHECK(to_string(multi_array<double, 3>{ 0.5, 1e20, -0.125 }) == "[0.5, 1e+20, -0.125]");
+    TB_CHECK(to_string(multi_array<int, 2, 2>{ { 1, 2 }, { 3, 4 } }) == "[[1, 2],\n [3, 4]]");
+    multi_array<int, 2, 2, 2> c;
+    for (int k = 0; k < 8; ++k) c.data()[k] = k;
+    TB_CHECK(to_string(c) == "[[[0, 1],\n  [2, 3]],\n [[4, 5],\n  [6, 7]]]");
+    TB_CHECK(to_string(multi_array<int, 1, 1>{ { 9 } }) == "[[9]]");
+
+    std::ostringstream os;
+    os << c << ' ' << multi_array<float, 2>{ 1.5f, 2 };
+    TB_CHECK(os.str() == to_string(c) + " [1.5, 2]");
+  }
+
+  void summarized()
+  {
+    multi_array<int, 1001> v;
+    for (int k = 0; k < 1001; ++k) v[k] = k;
+    TB_CHECK(to_string(v) == "[0, 1, 2, ..., 998, 999, 1000]");
+    TB_CHECK(to_string(v, { 1001, 3 }).size() > 4000);  // not above threshold
+
+    multi_array<int, 4, 4> m;
+    for (int k = 0; k < 16; ++k) m.data()[k] = k;
+    TB_CHECK(to_string(m, { 10, 1 }) == "[[0, ..., 3],\n ...,\n [12, ..., 15]]");
+    TB_CHECK(to_string(m, { 15, 2 }) == to_string(m, { 16, 2 }));  // 4 is not > 2 * 2
+    TB_CHECK(to_string(m, { 0, 0 }) == to_string(m));
+    multi_array<int, 2, 8> wide;
+    for (int k = 0; k < 16; ++k) wide.data()[k] = k;
+    TB_CHECK(to_string(wide, { 10, 2 }) == "[[0, 1, ..., 6, 7],\n [8, 9, ..., 14, 15]]");
+    multi_array<int, 5, 1, 3> deep;
+    for (int k = 0; k < 15; ++k) deep.data()[k] = k;
+    TB_CHECK(to_string(deep, { 1, 1 })
+             == "[[[0, ..., 2]],\n ...,\n [[12, ..., 14]]]");
+
+#if defined(__cpp_lib_format)
+    TB_CHECK(std::format("{}", v) == to_string(v));
+    TB_CHECK(std::format("{:f}", v) == to_string(v, { 1001, 3 }));
+    TB_CHECK(std::format("{:f}", m) == to_string(m));
+    TB_CHECK(throws([&] { (void)std::vformat("{:x}", std::make_format_args(m)); }));
+#endif
+  }
+
+  // Arrays of more rows than the tuned thread count are formatted in
+  // pieces; the result must not depend on where they join.
+  template<typename T, std::size_t M, std::size_t... N>
+    void parallel(T scale)
+    {
+      static multi_array<T, M, N...> a;
+      for (std::size_t k = 0; k < a.total_size(); ++k) a.data()[k] = T(k) * scale;
+      const std::string text = to_string(a, { std::size_t(-1), 3 });
+
+      std::string serial = "[";
+      format_rows_impl(serial, a, 0, M, 0, 0);
+      serial += ']';
+      TB_CHECK(text == serial);
+
+      // Rows of a matrix are single lines, joined by ",\n ".
+      if constexpr (sizeof...(N) == 1) {
+        std::string rows = "[";
+        for (std::size_t i = 0; i < M; ++i)
+          rows += (i > 0 ? ",\n " : "") + to_string(a[i], { std::size_t(-1), 3 });
+        TB_CHECK(text == rows + ']');
+      }
+    }
+
+} // namespace
+
+int main()
+{
+  // Split even small files between four threads; the parameters are read
+  // from the tuning cache on first use.
+  const temp_file cache("text_tune.txt");
+  write(cache, cpu_model() + "\ttext.threads\t4\n" + cpu_model() + "\ttext.min_chunk\t4096\n");
+  ::setenv("TB_MULTI_ARRAY_TUNE_CACHE", cache.path.string().c_str(), 1);
+  TB_CHECK(text_thread_count_impl(std::size_t{1} << 20) == 4);
+  TB_CHECK(text_thread_count_impl(8192) == 2);
+  TB_CHECK(text_thread_count_impl(100) == 1);
+
+  shapes();
+  line_endings();
+  errors();
+  large();
+  formatting();
+  summarized();
+  parallel<int, 5, 4000>(1);
+  parallel<double, 200, 50>(0.1);
+  parallel<float, 9, 4, 300>(-1.5f);
+  return report("text_test");
+}
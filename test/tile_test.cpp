@@ -0,0 +1,122 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Tiled traversal: for_each_tile visits every element exactly once, with
+// full tiles in the interior, tiles cut to the array along the bottom and
+// right edges, and the same tiles whether the bands run on one thread or
+// are shared between several.
+//
+//   g++ -std=c++20 -O2 -pthread -I src test/tile_test.cpp && ./a.out
+
+#include "multi_array_tile.h"
+#include "test.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  // Origin and extents of a tile.
+  using tile = std::array<std::size_t, 4>;
+
+  template<std::size_t TY, std::size_t TX, std::size_t R, std::size_t C>
+    void tiles(std::size_t threads)
+    {
+      static multi_array<int, R, C> a;
+      std::vector<std::atomic<int>> visits(R * C);
+      std::vector<tile> seen;
+      std::mutex m;
+      bool shape = true, elements = true;
+      for_each_tile<TY, TX>(a, [&](const multi_array_view<int>& v) {
+        const std::size_t i = v.row_offset(), j = v.col_offset();
+        bool ok = i % TY == 0 && j % TX == 0 && i < R && j < C
+                  && v.rows() == std::min(TY, R - i) && v.cols() == std::min(TX, C - j)
+                  && v.stride() == C && v.size() == v.rows() * v.cols();
+        bool same = true;
+        for (std::size_t r = 0; ok && r < v.rows(); ++r)
+          for (std::size_t c = 0; c < v.cols(); ++c) {
+            same = same && &v(r, c) == &a[i + r][j + c] && v.row(r) + c == &v(r, c);
+            ++visits[(i + r) * C + j + c];
+          }
+        std::lock_guard lock(m);
+        shape = shape && ok;
+        elements = elements && same;
+        seen.push_back({ i, j, v.rows(), v.cols() });
+      }, threads);
+      TB_CHECK(shape);
+      TB_CHECK(elements);
+      TB_CHECK(std::all_of(visits.begin(), visits.end(), [](auto& n) { return n == 1; }));
+      TB_CHECK(seen.size() == ((R + TY - 1) / TY) * ((C + TX - 1) / TX));
+
+      // On one thread, bands of rows top to bottom, each left to right.
+      if (threads == 1) TB_CHECK(std::is_sorted(seen.begin(), seen.end()));
+    }
+
+  template<std::size_t TY, std::size_t TX, std::size_t R, std::size_t C>
+    void all_threads()
+    {
+      tiles<TY, TX, R, C>(1);
+      tiles<TY, TX, R, C>(3);
+      tiles<TY, TX, R, C>(0);
+    }
+
+  // A const array gives views of const elements.
+  void const_array()
+  {
+    static const multi_array<int, 5, 6> a = [] {
+      multi_array<int, 5, 6> b{};
+      for (std::size_t j = 0; j < 6; ++j) b[0][j] = int(j + 1);
+      return b;
+    }();
+    int sum = 0;
+    for_each_tile<2, 4>(a, [&](const multi_array_view<const int>& v) {
+      v.for_each([&](const int& x) { sum += x; });
+    });
+    TB_CHECK(sum == 21);
+    const auto whole = make_view(a);
+    TB_CHECK(whole.rows() == 5 && whole.cols() == 6 && whole.stride() == 6);
+    TB_CHECK(whole.row_offset() == 0 && whole.col_offset() == 0 && &whole(4, 5) == &a[4][5]);
+  }
+
+} // namespace
+
+int main()
+{
+  all_threads<4, 4, 7, 13>();   // partial tiles on both edges
+  all_threads<4, 4, 16, 16>();  // whole tiles only
+  all_threads<1, 1, 1, 1>();    // a single element
+  all_threads<4, 4, 1, 1>();
+  all_threads<8, 16, 3, 5>();   // tiles larger than the array
+  all_threads<3, 2, 10, 7>();   // more bands than threads, unevenly shared
+  all_threads<1, 64, 9, 200>();
+  all_threads<2, 3, 2, 3>();
+  const_array();
+  return report("tile_test");
+}
@@ -0,0 +1,180 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Access tracing: accesses are counted against the outermost array they
+// were made through, with their kind, sequential ratio and strides, and
+// stop being attributed to an array once it is destroyed.
+//
+//   g++ -std=c++20 -O2 -I src test/trace_test.cpp && ./a.out
+
+#define TB_MULTI_ARRAY_TRACE
+#include "multi_array.h"
+#include "test.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <typeinfo>
+#include <vector>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  // The access log recorded for the instance at address, or an empty log.
+  trace_log log_for(const void* address, const std::type_info& type)
+  {
+    for (auto& [a, log] : trace_logs())
+      if (a == address && log.type && *log.type == type) return log;
+    return {};
+  }
+
+  void kinds()
+  {
+    trace_reset();
+    multi_array<int, 4, 8> a{};
+    for (std::size_t i = 0; i < 4; ++i)
+      for (std::size_t j = 0; j < 8; ++j) a(i, j) = 1;
+    int sum = 0;
+    for (std::size_t i = 0; i < 4; ++i)
+      for (std::size_t j = 0; j < 8; ++j) sum += a[i][j];
+    sum += a.at(3u, 7u);
+    for (const auto& row : a)
+      for (int x : row) sum += x;
+    TB_CHECK(sum == 65);
+
+    const trace_stats s = trace_stats_for(a);
+    TB_CHECK(s.type && *s.type == typeid(a));
+    TB_CHECK(s.accesses[int(trace_kind::call)] == 32);
+    TB_CHECK(s.accesses[int(trace_kind::subscript)] == 32);
+    TB_CHECK(s.accesses[int(trace_kind::at)] == 1);
+    TB_CHECK(s.accesses[int(trace_kind::iterator)] == 32);
+    // Rows are not traced instances of their own.
+    for (const auto& row : a) TB_CHECK(trace_stats_for(row).total() == 0);
+    TB_CHECK(trace_snapshot().size() == 1);
+
+    const trace_log log = log_for(&a, typeid(a));
+    TB_CHECK((log.extents == std::vector<std::size_t>{ 4, 8 }));
+    TB_CHECK(log.element_size == sizeof(int));
+    TB_CHECK(log.offsets.size() == 97);
+    bool offsets = true;
+    for (std::size_t k = 0; k < 32; ++k)
+      offsets = offsets && log.offsets[k] == k && log.offsets[32 + k] == k
+                && log.offsets[65 + k] == k;
+    TB_CHECK(offsets && log.offsets[64] == 31);
+  }
+
+  void strides()
+  {
+    trace_reset();
+    multi_array<double, 16, 16> a{};
+    for (std::size_t i = 0; i < 16; ++i)
+      for (std::size_t j = 0; j < 16; ++j) a(i, j) += 1;
+    trace_stats s = trace_stats_for(a);
+    TB_CHECK(s.sequential == 255 && s.random == 0 && s.backward == 0);
+    TB_CHECK(s.strides[1] == 255);
+
+    trace_reset();
+    for (std::size_t j = 0; j < 16; ++j)
+      for (std::size_t i = 0; i < 16; ++i) a[i][j] += 1;
+    s = trace_stats_for(a);
+    TB_CHECK(s.sequential == 0 && s.random == 255);
+    TB_CHECK(s.strides[5] == 240);  // 16 elements down a column
+    TB_CHECK(s.backward == 15);     // back to the top of the next column
+    TB_CHECK(s.sequential_ratio() == 0.0);
+  }
+
+  // An array made in the storage of a destroyed array is traced as
+  // itself, not as a row of the array that was there before.
+  void reused_storage()
+  {
+    using big = multi_array<int, 8, 8>;
+    using small = multi_array<int, 4>;
+    trace_reset();
+    alignas(big) unsigned char slot[sizeof(big)];
+
+    big* a = new (slot) big{};
+    a->at(0u, 0u) = 1;
+    int sum = (*a)[1][2];  // hands out a row, so a owns the whole slot
+    TB_CHECK(trace_stats_for(*a).total() == 2);
+    a->~big();
+
+    small* b = new (slot + sizeof(small)) small{};
+    sum += (*b)[0] + (*b)(1) + b->at(2u);
+    TB_CHECK(sum == 0);
+    const trace_stats s = trace_stats_for(*b);
+    TB_CHECK(s.total() == 3);
+    TB_CHECK(s.type && *s.type == typeid(small));
+    const trace_log log = log_for(b, typeid(small));
+    TB_CHECK((log.extents == std::vector<std::size_t>{ 4 }));
+    TB_CHECK((log.offsets == std::vector<std::uint64_t>{ 0, 1, 2 }));
+    // Nothing more was recorded against the array that was destroyed.
+    const trace_log old = log_for(slot, typeid(big));
+    TB_CHECK((old.offsets == std::vector<std::uint64_t>{ 0, 10 }));
+    b->~small();
+
+    // The same through a block-scoped array whose stack slot is reused.
+    trace_reset();
+    for (int k = 0; k < 2; ++k) {
+      if (k == 0) {
+        big c{};
+        sum += c[7][7];
+        TB_CHECK(trace_stats_for(c).total() == 1);
+      } else {
+        multi_array<int, 2, 4> d{};
+        sum += d[1][3];
+        TB_CHECK(trace_stats_for(d).total() == 1);
+        TB_CHECK(log_for(&d, typeid(d)).offsets == std::vector<std::uint64_t>{ 7 });
+      }
+    }
+  }
+
+  void reset()
+  {
+    multi_array<int, 3, 3> a{};
+    a(1, 1) = 2;
+    trace_reset();
+    TB_CHECK(trace_stats_for(a).total() == 0);
+    TB_CHECK(trace_snapshot().empty() && trace_logs().empty());
+  }
+
+  // Nothing is recorded during constant evaluation.
+  constexpr int constant()
+  {
+    multi_array<int, 2, 2> a{};
+    a(0, 1) = 3;
+    return a[0][1] + a.at(0u, 1u);
+  }
+  static_assert(constant() == 6);
+
+} // namespace
+
+int main()
+{
+  kinds();
+  strides();
+  reused_storage();
+  reset();
+  return report("trace_test");
+}
@@ -0,0 +1,233 @@
+/*
+Copyright (c) 2023 Tristan Bamford
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the “Software”), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+// Element-wise kernels on both sides of unroll_limit: fill, swap, == and
+// both transform overloads give the same results unrolled and looped, at
+// run time and during constant evaluation, and fill reads its value once
+// even when it refers to an element of the array being filled.
+//
+//   g++ -std=c++20 -O2 -I src test/unroll_test.cpp && ./a.out
+
+#include "multi_array.h"
+#include "test.h"
+
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+using namespace tb;
+using namespace tb::test;
+
+namespace {
+
+  // Calls f(x, k) for every element x of a and its row-major index k;
+  // data() cannot be indexed across rows during constant evaluation.
+  template<typename A, typename F>
+    constexpr void elements(A& a, F f, std::size_t first = 0)
+    {
+      using B = std::remove_const_t<A>;
+      for (std::size_t i = 0; i < B::size(); ++i) {
+        if constexpr (B::order() == 1) f(a[i], first + i);
+        else elements(a[i], f, first + i * B::value_type::total_size());
+      }
+    }
+
+  template<typename A>
+    constexpr void iota(A& a, int first = 0)
+    { elements(a, [&](auto& x, std::size_t k) { x = first + int(k); }); }
+
+  template<typename A>
+    constexpr bool all(const A& a, const typename A::element_type& v)
+    {
+      bool same = true;
+      elements(a, [&](auto& x, std::size_t) { same = same && x == v; });
+      return same;
+    }
+
+  // The element of a at row-major index k.
+  template<typename A>
+    constexpr auto& element(A& a, std::size_t k)
+    {
+      using B = std::remove_const_t<A>;
+      if constexpr (B::order() == 1) return a[k];
+      else return element(a[k / B::value_type::total_size()], k % B::value_type::total_size());
+    }
+
+  // a.fill(x) where x is an element of a, on the element written last and
+  // on one written in the middle.
+  template<typename A>
+    constexpr bool fill_from_element()
+    {
+      A a{};
+      iota(a, 1);
+      const auto last = element(a, A::total_size() - 1);
+      a.fill(element(a, A::total_size() - 1));
+      if (!all(a, last)) return false;
+      iota(a, 1);
+      const auto middle = element(a, A::total_size() / 2);
+      a.fill(element(a, A::total_size() / 2));
+      return all(a, middle);
+    }
+
+  template<typename A>
+    void fills()
+    {
+      TB_CHECK(fill_from_element<A>());
+      // Rows filled from an element of another row of the same array.
+      A a{};
+      iota(a, 5);
+      if constexpr (A::order() > 1) {
+        const auto v = element(a[0], 0);
+        a[A::size() - 1].fill(element(a[0], 0));
+        TB_CHECK(all(a[A::size() - 1], v) && element(a[0], 0) == v);
+      }
+    }
+
+  // a == b is false when any single element differs, and true otherwise.
+  template<typename A>
+    constexpr bool equality()
+    {
+      A a{}, b{};
+      iota(a);
+      iota(b);
+      if (!(a == b) || a != b) return false;
+      for (std::size_t k = 0; k < A::total_size(); ++k) {
+        element(b, k) += 1;
+        if (a == b || !(a != b)) return false;
+        element(b, k) -= 1;
+      }
+      return a == b;
+    }
+
+  template<typename A>
+    constexpr bool swaps()
+    {
+      A a{}, b{};
+      iota(a, 0);
+      iota(b, 100);
+      a.swap(b);
+      for (std::size_t k = 0; k < A::total_size(); ++k)
+        if (element(a, k) != 100 + int(k) || element(b, k) != int(k)) return false;
+      swap(a, b);
+      a.swap(a);
+      for (std::size_t k = 0; k < A::total_size(); ++k)
+        if (element(a, k) != int(k) || element(b, k) != 100 + int(k)) return false;
+      return true;
+    }
+
+  template<typename A>
+    constexpr bool transforms()
+    {
+      A a{}, b{};
+      iota(a, 1);
+      iota(b, 10);
+      int calls = 0;
+      const auto neg = transform(a, [&](int x) { ++calls; return -0.5 * x; });
+      const auto sum = transform(a, b, [&](int x, int y) { ++calls; return x + 2 * y; });
+      const auto same = transform(a, b, std::equal_to{});
+      static_assert(std::is_same_v<typename decltype(neg)::element_type, double>);
+      static_assert(std::is_same_v<decltype(sum), const A>);
+      if (calls != int(2 * A::total_size())) return false;
+      for (std::size_t k = 0; k < A::total_size(); ++k) {
+        const int x = 1 + int(k), y = 10 + int(k);
+        if (element(neg, k) != -0.5 * x || element(sum, k) != x + 2 * y || element(same, k))
+          return false;
+      }
+      return true;
+    }
+
+  template<typename A>
+    void all_kernels()
+    {
+      fills<A>();
+      TB_CHECK(equality<A>());
+      TB_CHECK(swaps<A>());
+      TB_CHECK(transforms<A>());
+    }
+
+  // The same during constant evaluation.
+  static_assert(fill_from_element<multi_array<int, 4>>());
+  static_assert(fill_from_element<multi_array<int, 2, 3>>());
+  static_assert(fill_from_element<multi_array<int, 5, 5>>());
+  static_assert(equality<multi_array<int, 16>>());
+  static_assert(equality<multi_array<int, 3, 7>>());
+  static_assert(swaps<multi_array<int, 2, 2, 2>>());
+  static_assert(swaps<multi_array<int, 20>>());
+  static_assert(transforms<multi_array<int, 4, 4>>());
+  static_assert(transforms<multi_array<int, 2, 9>>());
+
+  // Elements that are not trivially copyable take the element-wise paths.
+  void strings()
+  {
+    multi_array<std::string, 2, 2> a{ { "a", "b" }, { "c", "d" } };
+    multi_array<std::string, 2, 2> b{ { "w", "x" }, { "y", "z" } };
+    a.swap(b);
+    TB_CHECK((a == multi_array<std::string, 2, 2>{ { "w", "x" }, { "y", "z" } }));
+    TB_CHECK((b == multi_array<std::string, 2, 2>{ { "a", "b" }, { "c", "d" } }));
+    a.fill(a[1][0]);
+    TB_CHECK(all(a, "y"));
+    multi_array<std::string, 20> c;
+    c[7] = "long enough not to be stored inline in the string";
+    c.fill(c[7]);
+    TB_CHECK(all(c, "long enough not to be stored inline in the string"));
+  }
+
+  // == compares with the elements' ==: NaN is unequal to itself, -0 equal
+  // to 0, unrolled or not.
+  template<std::size_t N>
+    void floating()
+    {
+      multi_array<double, N> a{}, b{};
+      b[N - 1] = -0.0;
+      TB_CHECK(a == b);
+      a[N / 2] = std::nan("");
+      b[N / 2] = a[N / 2];
+      TB_CHECK(a != b && !(a == a));
+    }
+
+} // namespace
+
+int main()
+{
+  all_kernels<multi_array<int, 1>>();
+  all_kernels<multi_array<int, 7>>();
+  all_kernels<multi_array<int, 16>>();      // largest unrolled
+  all_kernels<multi_array<int, 17>>();      // smallest looped
+  all_kernels<multi_array<int, 4, 4>>();
+  all_kernels<multi_array<int, 2, 2, 4>>();
+  all_kernels<multi_array<int, 3, 6>>();
+  all_kernels<multi_array<int, 2, 3, 5>>();
+  all_kernels<multi_array<int, 100>>();
+  // Large fills stream; value is still read before the first store.
+  set_stream_threshold(1);
+  fills<multi_array<int, 100>>();
+  fills<multi_array<double, 3, 40>>();
+  set_stream_threshold(llc_size());
+  strings();
+  floating<3>();
+  floating<16>();
+  floating<40>();
+  return report("unroll_test");
+}